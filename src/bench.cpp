@@ -0,0 +1,317 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstdio>
+#include "parallel.h"
+#include "scoring.h"
+#include "wordbooks.h"
+#include "onlinemodel.h"
+
+using namespace std;
+
+/**
+ * @brief Microbenchmarks of Brain, written as JSON to stdout
+ *
+ * Results follow the layout of Google Benchmark's JSON reporter, so the
+ * usual compare tools can diff two runs. Brain.random gets a fixed seed,
+ * every run trains and tests the same words.
+ *
+ */
+class BrainBench {
+public:
+    BrainBench(Brain& brain, const unsigned train_words) : brain(brain), train_words {train_words} {}
+
+    void run();
+    string json() const;
+
+private:
+    typedef chrono::steady_clock Clock;
+
+    struct Result {
+        string name;
+        double iterations;
+        double ns_per_iteration;
+        vector<pair<string, double>> counters;
+    };
+
+    void bench_conversion();
+    void bench_import();
+    void bench_train_single();
+    void bench_train_bulk();
+    void bench_test_single();
+    void bench_test_trial();
+    void bench_online();
+    void add(const string& name, double iterations, double seconds, vector<pair<string, double>> counters = {});
+    static double seconds_since(const Clock::time_point start) {
+        return chrono::duration<double>(Clock::now() - start).count();
+    }
+    /// Peak resident memory of the process in bytes
+    static double peak_rss();
+
+    Brain& brain;
+    const unsigned train_words;
+    vector<Result> results;
+};
+
+double BrainBench::peak_rss() {
+    ifstream status("/proc/self/status");
+    string line;
+    while(getline(status, line)) {
+        if(line.compare(0, 6, "VmHWM:") == 0) return atof(line.c_str() + 6) * 1024;
+    }
+    return 0;
+}
+
+void BrainBench::add(const string& name, double iterations, double seconds, vector<pair<string, double>> counters) {
+    results.push_back({name, iterations, seconds * 1e9 / max(iterations, 1.0), counters});
+}
+
+/**
+ * @brief Runs all benchmarks in a fixed order
+ */
+void BrainBench::run() {
+    brain.random.reseed(42);
+    bench_conversion();
+    bench_import();
+    bench_train_single();
+    bench_train_bulk();
+    bench_test_single();
+    bench_test_trial();
+    bench_online();
+}
+
+/**
+ * @brief Throughput of str_to_brwrd on all lines of the wordbooks
+ */
+void BrainBench::bench_conversion() {
+    vector<string> lines;
+    size_t bytes {0};
+    for(const string& lang : brain.langlist) {
+        ifstream source(Brain::base_path + lang + ".txt");
+        string line;
+        while(getline(source, line)) {
+            bytes += line.size() + 1;
+            lines.push_back(line);
+        }
+    }
+    vector<unsigned char> brwrd;
+    size_t valid {0};
+    const auto start = Clock::now();
+    for(const string& line : lines) valid += brain.str_to_brwrd(line, brwrd);
+    const double took = seconds_since(start);
+    add("BM_str_to_brwrd", lines.size(), took, {{"bytes_per_second", bytes / took}, {"items_per_second", lines.size() / took},
+                                                 {"valid", static_cast<double>(valid)}});
+}
+
+/**
+ * @brief Wall time of import_wordbooks with and without the wordbook cache
+ *
+ * The cached run uses a cache file of its own, which is removed afterwards.
+ *
+ */
+void BrainBench::bench_import() {
+    const string cache = Brain::wordbook_cache;
+    Brain::wordbook_cache.clear();
+    auto start = Clock::now();
+    brain.import_wordbooks();
+    add("BM_import_wordbooks", 1, seconds_since(start), {{"threads", static_cast<double>(resolve_workers(brain.threads))}});
+    Brain::wordbook_cache = "get-lang-bench.cache";
+    brain.import_wordbooks(); // Writes the cache
+    start = Clock::now();
+    brain.import_wordbooks();
+    add("BM_import_wordbooks/cached", 1, seconds_since(start));
+    remove(Brain::wordbook_cache.c_str());
+    Brain::wordbook_cache = cache;
+}
+
+/**
+ * @brief Time of train_single per word length and maximum pattern length
+ *
+ * Every combination trains into empty pattern stores, lengths count the
+ * end sign.
+ *
+ */
+void BrainBench::bench_train_single() {
+    const unsigned saved_plen = brain.max_pattern_len;
+    for(unsigned plen : {2u, 4u, 8u, 0u}) {
+        brain.max_pattern_len = plen;
+        for(unsigned length : {5u, 8u, 12u, 16u}) {
+            vector<Brainword> words;
+            vector<unsigned> langs;
+            for(unsigned i = 0; i < brain.nlang; i++) {
+                for(size_t w = 0; w < brain.wb[i].size() && words.size() < (i + 1) * 2000; w++) {
+                    if(brain.wb[i][w].size() != length) continue;
+                    words.push_back(brain.wb[i][w]);
+                    langs.push_back(i);
+                }
+            }
+            brain.mind.assign(brain.maxlength2, PatternStore(brain.nlang));
+            const auto start = Clock::now();
+            for(size_t w = 0; w < words.size(); w++) brain.train_single(words[w], langs[w]);
+            add("BM_train_single/len:" + to_string(length) + "/plen:" + to_string(plen), words.size(), seconds_since(start));
+        }
+    }
+    brain.max_pattern_len = saved_plen;
+    brain.mind.assign(brain.maxlength2, PatternStore(brain.nlang));
+}
+
+/**
+ * @brief Speed of train_random_bulk and memory of Brain.mind afterwards
+ */
+void BrainBench::bench_train_bulk() {
+    streambuf* out = cout.rdbuf(nullptr);
+    const auto start = Clock::now();
+    brain.train_random_bulk(train_words);
+    const double took = seconds_since(start);
+    cout.rdbuf(out);
+    size_t patterns {0};
+    double mind_bytes {0};
+    for(const PatternStore& store : brain.mind) {
+        patterns += store.size();
+        mind_bytes += store.count_bytes();
+    }
+    add("BM_train_random_bulk/words:" + to_string(train_words), train_words, took,
+        {{"items_per_second", train_words / took}, {"patterns", static_cast<double>(patterns)},
+         {"mind_count_bytes", mind_bytes}, {"peak_rss_bytes", peak_rss()}});
+}
+
+/**
+ * @brief Latency of test_single on random words, single thread
+ *
+ * Runs with the specialized rating of fixedrate.h, the generic one and
+ * the compiled static table.
+ *
+ */
+void BrainBench::bench_test_single() {
+    vector<Brainword> words;
+    for(unsigned w = 0; w < 20'000; w++) {
+        const unsigned lang = brain.random[RandomStreams::TEST]() % brain.nlang;
+        words.push_back(brain.wb[lang][brain.random[RandomStreams::TEST]() % brain.wb[lang].size()]);
+    }
+    vector<double> scratch;
+    vector<double> ratings(brain.nlang);
+    vector<double> latencies;
+    latencies.reserve(words.size());
+    for(const string name : {"BM_test_single", "BM_test_single/generic", "BM_test_single/static"}) {
+        brain.specialized = name == "BM_test_single";
+        if(name == "BM_test_single/static") brain.compiled.build(brain.mind, brain.nlang);
+        latencies.clear();
+        const auto start = Clock::now();
+        for(const Brainword& word : words) {
+            const auto word_start = Clock::now();
+            brain.test_single(word, scratch, &ratings[0]);
+            latencies.push_back(seconds_since(word_start) * 1e9);
+        }
+        const double took = seconds_since(start);
+        sort(latencies.begin(), latencies.end());
+        vector<pair<string, double>> counters {{"p50_ns", latencies[latencies.size() / 2]},
+                                               {"p99_ns", latencies[latencies.size() * 99 / 100]}};
+        if(brain.compiled.ready()) counters.emplace_back("static_bytes", brain.compiled.memory_usage());
+        add(name, words.size(), took, counters);
+    }
+    brain.compiled.clear();
+    brain.specialized = true;
+}
+
+/**
+ * @brief Throughput of test_trial on Brain.threads workers
+ */
+void BrainBench::bench_test_trial() {
+    brain.init_trial_wb(20'000);
+    size_t words {0};
+    for(const vector<unsigned>& lang : brain.trial_wb) words += lang.size();
+    const auto start = Clock::now();
+    const double success = brain.test_trial();
+    const double took = seconds_since(start);
+    add("BM_test_trial", words, took, {{"items_per_second", words / took}, {"success", success},
+                                        {"threads", static_cast<double>(resolve_workers(brain.threads))}});
+}
+
+/**
+ * @brief Throughput of OnlineModel, readers classify while one writer trains
+ *
+ * Uses Brain.threads - 1 readers, at least one. Readers stop once the
+ * writer published its last batch.
+ *
+ */
+void BrainBench::bench_online() {
+    vector<Brainword> words;
+    vector<unsigned> langs;
+    if(!brain.draw_random(50'000, words, langs, RandomStreams::TRAIN)) return;
+    OnlineModel online(brain, 5'000);
+    const unsigned readers = max(resolve_workers(brain.threads), 2u) - 1;
+    atomic<bool> training {true};
+    atomic<size_t> classified {0};
+    double took {0};
+    const auto start = Clock::now();
+    run_workers(readers + 1, [&](unsigned t) {
+        if(t == 0) {
+            for(size_t w = 0; w < words.size(); w++) online.train(words[w], langs[w]);
+            online.publish();
+            took = seconds_since(start);
+            training.store(false);
+            return;
+        }
+        vector<double> scratch;
+        vector<double> ratings(brain.nlang);
+        size_t count {0};
+        for(size_t w = t; training.load(); w = (w + readers) % words.size(), count++) {
+            online.classify(words[w], scratch, &ratings[0]);
+        }
+        classified.fetch_add(count);
+    });
+    add("BM_online/readers:" + to_string(readers), words.size(), took,
+        {{"items_per_second", words.size() / took}, {"classified_per_second", classified.load() / took},
+         {"publishes", static_cast<double>(online.version())}});
+}
+
+/**
+ * @brief Formats context and results like Google Benchmark's JSON reporter
+ */
+string BrainBench::json() const {
+    ostringstream out;
+    out.precision(10);
+    out << "{\n  \"context\": {\n"
+        << "    \"executable\": \"get-lang-bench\",\n"
+        << "    \"num_cpus\": " << resolve_workers(0) << ",\n"
+        << "    \"threads\": " << resolve_workers(brain.threads) << ",\n"
+        << "    \"scoring_kernel\": \"" << score_kernel_name() << "\",\n"
+        << "    \"train_words\": " << train_words << ",\n"
+        << "    \"seed\": 42\n  },\n  \"benchmarks\": [";
+    for(size_t r = 0; r < results.size(); r++) {
+        const Result& result = results[r];
+        out << (r == 0 ? "\n" : ",\n") << "    {\n"
+            << "      \"name\": \"" << result.name << "\",\n"
+            << "      \"iterations\": " << result.iterations << ",\n"
+            << "      \"real_time\": " << result.ns_per_iteration << ",\n"
+            << "      \"time_unit\": \"ns\"";
+        for(const pair<string, double>& counter : result.counters) {
+            out << ",\n      \"" << counter.first << "\": " << counter.second;
+        }
+        out << "\n    }";
+    }
+    out << "\n  ]\n}\n";
+    return out.str();
+}
+
+/**
+ * @brief Runs the benchmarks, get-lang-bench [train words] [threads]
+ */
+int main(int argc, char** argv) {
+    const unsigned train_words = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200'000;
+    const unsigned threads = argc > 2 ? strtoul(argv[2], nullptr, 10) : 1;
+    streambuf* results = cout.rdbuf(cerr.rdbuf()); // Keeps stdout clean of progress messages
+    Brain brain(4, 25, {"afr", "esp", "fre", "nla", "swe"}, 8, threads);
+    brain.threads = threads;
+    BrainBench bench(brain, train_words);
+    bench.run();
+    cout.rdbuf(results);
+    cout << bench.json();
+    return 0;
+}
@@ -0,0 +1,269 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdlib>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include "split.h"
+#include "wordbooks.h"
+#include "server.h"
+#include "cli.h"
+
+using namespace std;
+
+/**
+ * @brief Prints the usage of the non-interactive front end
+ */
+static void print_usage(const char* program) {
+    cerr << "Usage: " << program << " [options] [file ...]\n"
+            "Classifies every line of the files (or stdin if none or -) and writes\n"
+            "\"label<TAB>rates\" per line to stdout.\n\n"
+            "  --model FILE      load a model snapshot instead of importing wordbooks\n"
+            "  --wordbook-cache FILE\n"
+            "                    reuse converted wordbooks stored in FILE if settings\n"
+            "                    and sources match, rewrite it otherwise (default: off)\n"
+            "  --langs a,b,...   languages to import (default: all shipped wordbooks)\n"
+            "  --min N           minimum length of words (default 1)\n"
+            "  --max N           maximum length of words, 0 is unlimited (default 0)\n"
+            "  --pattern N       maximum pattern length, 0 is unlimited (default 8)\n"
+            "  --train N         train on N random words of the wordbooks\n"
+            "  --decay N,F       multiply all counts by F (default 0.5) every N trained words\n"
+            "  --compact M,E,K   drop patterns seen less than M times, with an entropy\n"
+            "                    above E or beyond the K most frequent per position\n"
+            "  --lookups N       print the share of missing slices per pattern length\n"
+            "                    on N words of the wordbooks\n"
+            "  --save FILE       save the model after training, compacting and compiling\n"
+            "  --freeze P        freeze with precision float32, uint16 or uint8\n"
+            "  --compile         compile the model into a static hash table for\n"
+            "                    classifying and drop the trained pattern stores, a\n"
+            "                    compiled model can't be trained or frozen anymore\n"
+            "  --seed N          seed of the random draws, same seed and settings train\n"
+            "                    the same model regardless of --threads\n"
+            "  --threads N       worker threads, 0 uses all cores (default 0)\n"
+            "  --batch N         words classified per parallel batch\n"
+            "  --serve PATH      serve lines sent to the Unix socket PATH instead of\n"
+            "                    reading files, \"!stats\" returns latencies and\n"
+            "                    \"!shutdown\" stops the server\n"
+            "  --stats FILE      write runtime statistics as JSON when done\n"
+            "  --document C      classify each input as a whole, stop once the leading\n"
+            "                    language's mean rate leads by C, writes\n"
+            "                    \"input<TAB>label<TAB>confidence<TAB>words\" per input\n";
+}
+
+/**
+ * @brief Parses a whole string as unsigned number
+ * @return False if text holds anything else or the number is out of range
+ *
+ */
+static bool parse_number(const string& text, unsigned long long& value) {
+    if(text.empty() || !isdigit(static_cast<unsigned char>(text[0]))) return false; // strtoull accepts signs
+    char* end;
+    errno = 0;
+    value = strtoull(text.c_str(), &end, 10);
+    return *end == '\0' && errno == 0;
+}
+
+/**
+ * @brief Parses a whole string as finite floating point number
+ * @return False if text holds anything else or the number is out of range
+ *
+ */
+static bool parse_number(const string& text, double& value) {
+    if(text.empty()) return false;
+    char* end;
+    errno = 0;
+    value = strtod(text.c_str(), &end);
+    return *end == '\0' && errno == 0 && isfinite(value);
+}
+
+/**
+ * @brief Returns the unsigned value of an option, exits on a missing or bad value
+ */
+static unsigned option_value(int argc, char** argv, int& i) {
+    if(i + 1 >= argc) {
+        cerr << "ERROR: " << argv[i] << " needs a value!\n";
+        exit(-1);
+    }
+    unsigned long long value;
+    if(!parse_number(argv[++i], value) || value > UINT_MAX) {
+        cerr << "ERROR: " << argv[i - 1] << " expects a number, got " << argv[i] << "!\n";
+        exit(-1);
+    }
+    return value;
+}
+
+/**
+ * @brief Runs the non-interactive front end
+ *
+ * Sets up Brain from a model or the wordbooks, optionally trains, saves and
+ * freezes it and then streams all inputs through Brain::classify_stream.
+ * Messages of Brain go to stderr, stdout only receives the results.
+ *
+ * @param argc, argv Arguments of main
+ * @return Exit code
+ *
+ */
+int run_cli(int argc, char** argv) {
+    string model;
+    string save;
+    string precision;
+    string stats;
+    string compact;
+    string decay;
+    string serve;
+    vector<string> langs {DEFAULT_LANGS};
+    vector<string> inputs;
+    unsigned minlength {1};
+    unsigned maxlength {0};
+    unsigned maxpattern {8};
+    unsigned train {0};
+    unsigned threads {0};
+    unsigned batch {0};
+    unsigned lookups {0};
+    bool compile {false};
+    string seed;
+    string document;
+    for(int i = 1; i < argc; i++) {
+        const string arg = argv[i];
+        if(arg == "--help" || arg == "-h") {
+            print_usage(argv[0]);
+            return 0;
+        }
+        else if(arg == "--compile") compile = true;
+        else if(arg == "--model" && i + 1 < argc) model = argv[++i];
+        else if(arg == "--wordbook-cache" && i + 1 < argc) Brain::wordbook_cache = argv[++i];
+        else if(arg == "--save" && i + 1 < argc) save = argv[++i];
+        else if(arg == "--freeze" && i + 1 < argc) precision = argv[++i];
+        else if(arg == "--stats" && i + 1 < argc) stats = argv[++i];
+        else if(arg == "--compact" && i + 1 < argc) compact = argv[++i];
+        else if(arg == "--decay" && i + 1 < argc) decay = argv[++i];
+        else if(arg == "--seed" && i + 1 < argc) seed = argv[++i];
+        else if(arg == "--serve" && i + 1 < argc) serve = argv[++i];
+        else if(arg == "--langs" && i + 1 < argc) langs = split(argv[++i], ',');
+        else if(arg == "--document" && i + 1 < argc) document = argv[++i];
+        else if(arg == "--min") minlength = option_value(argc, argv, i);
+        else if(arg == "--max") maxlength = option_value(argc, argv, i);
+        else if(arg == "--pattern") maxpattern = option_value(argc, argv, i);
+        else if(arg == "--train") train = option_value(argc, argv, i);
+        else if(arg == "--threads") threads = option_value(argc, argv, i);
+        else if(arg == "--batch") batch = option_value(argc, argv, i);
+        else if(arg == "--lookups") lookups = option_value(argc, argv, i);
+        else if(arg.size() > 1 && arg[0] == '-' && arg[1] == '-') {
+            cerr << "ERROR: Unknown option or missing value " << arg << "!\n";
+            print_usage(argv[0]);
+            return -1;
+        }
+        else inputs.push_back(arg);
+    }
+    if(inputs.empty()) inputs.push_back("-");
+    if(model.empty() && train == 0) {
+        cerr << "ERROR: Nothing to classify with, give --model or --train!\n";
+        return -1;
+    }
+    unsigned long long random_seed {RandomStreams::clock_seed()};
+    if(!seed.empty() && !parse_number(seed, random_seed)) {
+        cerr << "ERROR: --seed expects a number, got " << seed << "!\n";
+        return -1;
+    }
+    double confidence {0};
+    if(!document.empty() && (!parse_number(document, confidence) || confidence < 0)) {
+        cerr << "ERROR: --document expects a confidence of 0 or more, got " << document << "!\n";
+        return -1;
+    }
+    CompactOptions compact_options;
+    if(!compact.empty()) {
+        const vector<string> values = split(compact, ',');
+        unsigned long long min_count {compact_options.min_count};
+        unsigned long long top_k {compact_options.top_k};
+        bool valid = !values.empty() && values.size() <= 3;
+        if(valid) valid = parse_number(values[0], min_count) && min_count <= UINT_MAX;
+        if(valid && values.size() > 1) {
+            valid = parse_number(values[1], compact_options.max_entropy) && compact_options.max_entropy >= 0;
+        }
+        if(valid && values.size() > 2) valid = parse_number(values[2], top_k);
+        if(!valid) {
+            cerr << "ERROR: --compact expects M,E,K with counts M and K and an entropy E of 0 or more, got "
+                 << compact << "!\n";
+            return -1;
+        }
+        compact_options.min_count = min_count;
+        compact_options.top_k = top_k;
+    }
+    unsigned decay_every {0};
+    double decay_factor {0.5};
+    if(!decay.empty()) {
+        const vector<string> values = split(decay, ',');
+        unsigned long long every {0};
+        bool valid = !values.empty() && values.size() <= 2 && parse_number(values[0], every) && every <= UINT_MAX;
+        if(valid && values.size() > 1) {
+            // Factors of 1 or more would overflow the count rows, 0 would wipe them
+            valid = parse_number(values[1], decay_factor) && decay_factor > 0 && decay_factor < 1;
+        }
+        decay_every = every;
+        if(!valid) {
+            cerr << "ERROR: --decay expects N,F with a factor F between 0 and 1, got " << decay << "!\n";
+            return -1;
+        }
+    }
+
+    ios::sync_with_stdio(false);
+    ostream results(cout.rdbuf());
+    cout.rdbuf(cerr.rdbuf()); // Keeps stdout clean of progress messages
+
+    unique_ptr<Brain> brain;
+    if(!model.empty()) brain = make_unique<Brain>(model, random_seed);
+    else brain = make_unique<Brain>(minlength, maxlength, langs, maxpattern, threads, random_seed);
+    Brain& Neurons = *brain;
+    Neurons.threads = threads;
+    if(batch != 0) Neurons.batch_size = batch;
+    Neurons.decay_every = decay_every;
+    Neurons.decay_factor = decay_factor;
+
+    if(train != 0) Neurons.train_random_bulk(train);
+    if(!compact.empty()) Neurons.compact(compact_options, 20'000);
+    if(lookups != 0) Neurons.report_lookups(lookups);
+    if(compile) Neurons.compile();
+    if(!save.empty() && !Neurons.save_model(save)) return -1;
+    if(precision == "float32") Neurons.freeze(FrozenModel::FLOAT32);
+    else if(precision == "uint16") Neurons.freeze(FrozenModel::UINT16);
+    else if(precision == "uint8") Neurons.freeze(FrozenModel::UINT8);
+    else if(!precision.empty()) cerr << "Unknown precision " << precision << ", model stays unfrozen\n";
+
+    int code {0};
+    if(!serve.empty()) {
+        Server server(Neurons, serve);
+        if(!server.run()) code = -1;
+        cerr << server.stats_json() << "\n";
+        inputs.clear();
+    }
+    for(const string& input : inputs) {
+        ifstream file;
+        if(input != "-") {
+            file.open(input);
+            if(!file) {
+                cerr << input << " can't be opened!\n";
+                code = -1;
+                continue;
+            }
+        }
+        istream& source = input == "-" ? cin : file;
+        if(confidence > 0) {
+            const DocumentClassification result = Neurons.classify_document(source, confidence);
+            results << input << '\t' << Neurons.langlist[result.label] << '\t' << result.confidence << '\t'
+                    << result.tokens << '\n';
+        }
+        else Neurons.classify_stream(source, results);
+    }
+    results.flush();
+    if(!stats.empty()) {
+        ofstream stats_file(stats);
+        stats_file << Neurons.stats_json();
+        if(!stats_file) cerr << stats << " can't be written!\n";
+    }
+    cout.rdbuf(results.rdbuf());
+    return code;
+}
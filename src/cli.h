@@ -0,0 +1,12 @@
+#ifndef CLI_H_INCLUDED
+#define CLI_H_INCLUDED
+#include <vector>
+#include <string>
+
+/// Shipped wordbooks imported unless other languages are given
+const std::vector<std::string> DEFAULT_LANGS {"afr", "esp", "fre", "nla", "swe"};
+
+/// Runs the non-interactive front end, returns the exit code
+int run_cli(int argc, char** argv);
+
+#endif // CLI_H_INCLUDED
@@ -0,0 +1,144 @@
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include "patternstore.h"
+#include "wordbook.h"
+#include "fixedrate.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FIXEDRATE_X86
+#endif
+
+using namespace std;
+
+/// Longest word rated by the unlimited specialization, longer words take the generic path
+static const unsigned UNLIMITED_MAX {32};
+
+/**
+ * @brief Adds a count row scaled by factor to a rating row
+ */
+template<unsigned Width, typename Count>
+static inline void add_row(double* ratings, const Count* counts, const double factor) {
+    for(unsigned k = 0; k < Width; k++) ratings[k] += counts[k] * factor;
+}
+
+/**
+ * @brief Rates a word with constant row width and maximum pattern length
+ *
+ * Same steps as Brain::rate_patterns followed by the scaling of
+ * Brain::test_stores. With MaxPattern 0 every word length up to
+ * UNLIMITED_MAX is rated. Always inlined, so each caller compiles it for
+ * its own instruction set.
+ *
+ */
+template<unsigned Width, unsigned MaxPattern>
+__attribute__((always_inline))
+static inline unsigned rate_body(const vector<PatternStore>& stores, const Brainword& word, const unsigned nlang,
+                                 const double def_rating, const double* scale, double* ratings) {
+    const unsigned rows = MaxPattern == 0 ? UNLIMITED_MAX : MaxPattern;
+    alignas(32) double rating_per_pattern[rows][Width];
+    const unsigned size = word.size();
+    const unsigned plen = MaxPattern == 0 || size < rows ? size : rows;
+    for(unsigned i = 0; i < plen; i++) fill(rating_per_pattern[i], rating_per_pattern[i] + Width, 0.0);
+
+    unsigned hits {0};
+    for(unsigned j = 0; j < size; j++) {
+        const PatternStore& store = stores[j];
+        const unsigned reach = min(plen, size - j);
+        unsigned node = PatternStore::NIL;
+        for(unsigned i = 1; i <= reach; i++) {
+            node = store.find(node, word[j + i - 1]);
+            if(node == PatternStore::NIL) {
+                // Slices are stored prefix closed, so all longer slices miss as well
+                for(; i <= reach; i++) {
+                    for(unsigned k = 0; k < Width; k++) rating_per_pattern[i - 1][k] += def_rating;
+                }
+                break;
+            }
+            const uint16_t* narrow = store.narrow_row(node);
+            if(narrow[0] != PatternStore::PROMOTED) add_row<Width>(rating_per_pattern[i - 1], narrow + 1, 1.0 / narrow[0]);
+            else {
+                const unsigned* rates = store.wide_row(node);
+                add_row<Width>(rating_per_pattern[i - 1], rates + 1, 1.0 / rates[0]);
+            }
+            hits++;
+        }
+    }
+
+    double sums[Width] {};
+    for(unsigned i = 1; i <= plen; i++) {
+        const double slices = size - i + 1;
+        for(unsigned k = 0; k < Width; k++) sums[k] += scale[i - 1] * (rating_per_pattern[i - 1][k] / slices - 0.5) + 0.5;
+    }
+    for(unsigned k = 0; k < nlang; k++) ratings[k] = sums[k] / plen;
+    return hits;
+}
+
+/**
+ * @brief Specialization for cpus without AVX2
+ */
+template<unsigned Width, unsigned MaxPattern>
+static unsigned rate_fixed(const vector<PatternStore>& stores, const Brainword& word, const unsigned nlang,
+                           const double def_rating, const double* scale, double* ratings) {
+    return rate_body<Width, MaxPattern>(stores, word, nlang, def_rating, scale, ratings);
+}
+
+#ifdef FIXEDRATE_X86
+/**
+ * @brief Specialization using AVX2, four doubles per operation
+ */
+template<unsigned Width, unsigned MaxPattern>
+__attribute__((target("avx2")))
+static unsigned rate_fixed_avx2(const vector<PatternStore>& stores, const Brainword& word, const unsigned nlang,
+                                const double def_rating, const double* scale, double* ratings) {
+    return rate_body<Width, MaxPattern>(stores, word, nlang, def_rating, scale, ratings);
+}
+#endif
+
+/**
+ * @brief Picks the AVX2 or the plain specialization of one setting
+ */
+template<unsigned Width, unsigned MaxPattern>
+static FixedRate pick() {
+#ifdef FIXEDRATE_X86
+    if(__builtin_cpu_supports("avx2")) return rate_fixed_avx2<Width, MaxPattern>;
+#endif
+    return rate_fixed<Width, MaxPattern>;
+}
+
+/**
+ * @brief Picks the specialization for 4, 8 or 16 padded languages and patterns of 4, 6, 8 or unlimited length
+ *
+ * The AVX2 variant is taken if the cpu supports it.
+ * Unlimited patterns are only specialized if no word gets longer than
+ * UNLIMITED_MAX, including the end sign.
+ *
+ */
+FixedRate select_fixed_rate(const unsigned width, const unsigned max_pattern_len, const unsigned maxlength2) {
+    if(max_pattern_len == 0 && (maxlength2 == 0 || maxlength2 > UNLIMITED_MAX)) return nullptr;
+    if(width == 4) {
+        switch(max_pattern_len) {
+            case 0: return pick<4, 0>();
+            case 4: return pick<4, 4>();
+            case 6: return pick<4, 6>();
+            case 8: return pick<4, 8>();
+        }
+    }
+    if(width == 8) {
+        switch(max_pattern_len) {
+            case 0: return pick<8, 0>();
+            case 4: return pick<8, 4>();
+            case 6: return pick<8, 6>();
+            case 8: return pick<8, 8>();
+        }
+    }
+    if(width == 16) {
+        switch(max_pattern_len) {
+            case 0: return pick<16, 0>();
+            case 4: return pick<16, 4>();
+            case 6: return pick<16, 6>();
+            case 8: return pick<16, 8>();
+        }
+    }
+    return nullptr;
+}
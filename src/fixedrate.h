@@ -0,0 +1,26 @@
+#ifndef FIXEDRATE_H_INCLUDED
+#define FIXEDRATE_H_INCLUDED
+#include <vector>
+#include "patternstore.h"
+#include "wordbook.h"
+
+using std::vector;
+
+/**
+ * Rating of a word like Brain::test_stores, specialized at compile time
+ * for a padded row width and a maximum pattern length.
+ *
+ * Ratings per pattern length live in a fixed array on the stack and all
+ * loops over languages have constant bounds, so the compiler unrolls and
+ * vectorizes them and inlines the count kernels. Results are the same as
+ * the generic path of Brain::test_stores.
+ */
+
+/// Rates a word on pattern stores into ratings (nlang values), returns the amount of hits
+typedef unsigned (*FixedRate)(const vector<PatternStore>& stores, const Brainword& word, const unsigned nlang,
+                              const double def_rating, const double* scale, double* ratings);
+
+/// Specialization for the row width and maximum pattern length (0 is unlimited), nullptr if none is compiled
+FixedRate select_fixed_rate(const unsigned width, const unsigned max_pattern_len, const unsigned maxlength2);
+
+#endif // FIXEDRATE_H_INCLUDED
@@ -0,0 +1,251 @@
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include "patternstore.h"
+#include "scoring.h"
+#include "wordbook.h"
+#include "frozenmodel.h"
+
+using namespace std;
+
+const uint32_t FrozenModel::TAG_MASK;
+const uint32_t FrozenModel::TAG_DENSE;
+const uint32_t FrozenModel::TAG_SINGLE;
+const uint32_t FrozenModel::TAG_PAIR;
+
+/**
+ * @brief Builds the weights of all patterns
+ *
+ * @param stores Trained pattern stores, passed again to score the words
+ * @param langs Count of languages
+ * @param scales Scale per pattern length
+ * @param def Rating per language of unknown patterns
+ * @param precision Float weights or 16 / 8 bit quantized weights
+ *
+ */
+void FrozenModel::freeze(const vector<PatternStore>& stores, const unsigned langs, const vector<double>& scales, const double def,
+                         const Precision precision) {
+    clear();
+    built = true;
+    nlang = langs;
+    scale = scales;
+    def_rating = def;
+    width = padded_width(nlang);
+    this->precision = precision;
+    if(precision == FLOAT32) {
+        weights.resize(stores.size());
+        for(unsigned j = 0; j < stores.size(); j++) freeze_float(stores[j], j);
+        return;
+    }
+    const unsigned levels = precision == UINT16 ? 65535 : 255;
+    log_min = log(precision == UINT16 ? 1e-6 : 1e-4);
+    decode.assign(levels + 1, 0);
+    for(unsigned code = 1; code <= levels; code++) {
+        decode[code] = exp(log_min * (levels - code) / (levels - 1));
+    }
+    entries.resize(stores.size());
+    codes.resize(stores.size());
+    for(unsigned j = 0; j < stores.size(); j++) freeze_quantized(stores[j], j);
+}
+
+/**
+ * @brief Builds float weight rows of one position
+ */
+void FrozenModel::freeze_float(const PatternStore& store, const unsigned j) {
+    const size_t nodes = store.size() + 1;
+    weights[j].assign(nodes * width, 0);
+    for(unsigned node = 1; node < nodes; node++) {
+        const double sum = store.count(node, 0);
+        float* row = &weights[j][node * width];
+        for(unsigned k = 0; k < nlang; k++) row[k] = store.count(node, k + 1) / sum;
+    }
+}
+
+/**
+ * @brief Builds quantized entries and code rows of one position
+ */
+void FrozenModel::freeze_quantized(const PatternStore& store, const unsigned j) {
+    const size_t nodes = store.size() + 1;
+    const unsigned code_size = precision == UINT16 ? 2 : 1;
+    entries[j].assign(nodes, 0);
+    codes[j].clear();
+    vector<unsigned> rates(nlang + 1);
+    for(unsigned node = 1; node < nodes; node++) {
+        for(unsigned k = 0; k <= nlang; k++) rates[k] = store.count(node, k);
+        unsigned seen[2] {};
+        unsigned langs_seen {0};
+        for(unsigned k = 0; k < nlang; k++) {
+            if(rates[k + 1] == 0) continue;
+            if(langs_seen < 2) seen[langs_seen] = k;
+            langs_seen++;
+        }
+        uint32_t& entry = entries[j][node];
+        if(langs_seen == 1) entry = TAG_SINGLE | seen[0];
+        else if(langs_seen == 2 && nlang <= 128) {
+            const double share = static_cast<double>(rates[seen[0] + 1]) / (rates[seen[0] + 1] + rates[seen[1] + 1]);
+            entry = TAG_PAIR | seen[0] << 23 | seen[1] << 16 | static_cast<uint32_t>(lround(share * 65535));
+        }
+        else {
+            entry = TAG_DENSE | codes[j].size() / (nlang * code_size);
+            for(unsigned k = 0; k < nlang; k++) {
+                const unsigned code = quantize(static_cast<double>(rates[k + 1]) / rates[0]);
+                codes[j].push_back(code & 0xFF);
+                if(code_size == 2) codes[j].push_back(code >> 8);
+            }
+        }
+    }
+    codes[j].shrink_to_fit();
+}
+
+/**
+ * @brief Rounds a propability to the nearest code on log scale
+ */
+unsigned FrozenModel::quantize(const double p) const {
+    const unsigned levels = decode.size() - 1;
+    if(p <= 0) return 0;
+    const double position = 1 - log(p) / log_min;
+    if(position < 0) return p < decode[1] / 2 ? 0 : 1;
+    return min<long>(levels, lround((levels - 1) * position) + 1);
+}
+
+/**
+ * @brief Drops the weights, the model is unusable until frozen again
+ */
+void FrozenModel::clear() {
+    built = false;
+    weights.clear();
+    entries.clear();
+    codes.clear();
+    decode.clear();
+}
+
+/**
+ * @brief Sets the scale of one pattern length, no weight changes
+ * @param plen Pattern length
+ * @param value New scale
+ *
+ */
+void FrozenModel::rescale(const unsigned plen, const double value) {
+    if(plen != 0 && plen <= scale.size()) scale[plen - 1] = value;
+}
+
+/**
+ * @brief Takes over grown pattern stores and scale without freezing again
+ *
+ * Stores beyond the frozen ones have to be empty, they only get a row for
+ * their root. Nothing happens unless frozen.
+ *
+ * @param stores The grown pattern stores
+ * @param scales Scale per pattern length
+ *
+ */
+void FrozenModel::extend(const vector<PatternStore>& stores, const vector<double>& scales) {
+    if(!ready()) return;
+    scale = scales;
+    if(precision == FLOAT32) weights.resize(stores.size(), vector<float>(width, 0));
+    else {
+        entries.resize(stores.size(), vector<uint32_t>(1, 0));
+        codes.resize(stores.size());
+    }
+}
+
+/**
+ * @brief Rates a word
+ *
+ * Weights of hits are added up with factor scale / (amount of slices) of
+ * their length, misses and the scale offset are added once at the end.
+ *
+ * @param stores The pattern stores the model was frozen on
+ * @param word Word to rate
+ * @param max_pattern_len The maximum relevant pattern length (0 is unlimited)
+ * @param scratch Buffer reused between calls
+ * @param ratings Receives the propabilities for each language
+ * @return Amount of patterns found
+ *
+ */
+unsigned FrozenModel::score(const vector<PatternStore>& stores, const Brainword& word, const unsigned max_pattern_len,
+                            vector<double>& scratch, double* ratings) const {
+    unsigned plen{};
+    if(max_pattern_len == 0 || word.size() < max_pattern_len) plen = word.size();
+    else plen = max_pattern_len;
+
+    scratch.assign(width + plen, 0);
+    double* sum = &scratch[0];
+    double* factors = &scratch[width];
+    double offset {0};
+    for(unsigned i = 1; i <= plen; i++) {
+        factors[i - 1] = scale[i - 1] / (word.size() - i + 1);
+        offset += 0.5 - 0.5 * scale[i - 1];
+    }
+    double missed {0};
+    unsigned hits {0};
+    for(unsigned j = 0; j < word.size(); j++) {
+        const unsigned reach = min<size_t>(plen, word.size() - j);
+        const PatternStore& store = stores[j];
+        const float* rows = precision == FLOAT32 ? weights[j].data() : nullptr;
+        unsigned node = PatternStore::NIL;
+        for(unsigned i = 1; i <= reach; i++) {
+            node = store.find(node, word[j + i - 1]);
+            if(node == PatternStore::NIL) {
+                // Slices are stored prefix closed, so all longer slices miss as well
+                for(; i <= reach; i++) missed += factors[i - 1];
+                break;
+            }
+            hits++;
+            if(rows) kernel(sum, rows + static_cast<size_t>(node) * width, width, factors[i - 1]);
+            else add_quantized(sum, j, node, factors[i - 1]);
+        }
+    }
+    for(unsigned k = 0; k < nlang; k++) ratings[k] = (sum[k] + missed * def_rating + offset) / plen;
+    return hits;
+}
+
+/**
+ * @brief Adds the decoded weights of one pattern
+ * @param sum Summed up weights per language
+ * @param j Position of the pattern
+ * @param node Node of the pattern
+ * @param factor Factor of the pattern length
+ *
+ */
+void FrozenModel::add_quantized(double* sum, const unsigned j, const unsigned node, const double factor) const {
+    const uint32_t entry = entries[j][node];
+    const uint32_t tag = entry & TAG_MASK;
+    if(tag == TAG_SINGLE) sum[entry & ~TAG_MASK] += factor;
+    else if(tag == TAG_PAIR) {
+        const double share = (entry & 0xFFFF) / 65535.0;
+        sum[(entry >> 23) & 0x7F] += share * factor;
+        sum[(entry >> 16) & 0x7F] += (1 - share) * factor;
+    }
+    else if(precision == UINT16) {
+        const uint8_t* row = &codes[j][static_cast<size_t>(entry) * nlang * 2];
+        for(unsigned k = 0; k < nlang; k++) sum[k] += decode[row[2 * k] | row[2 * k + 1] << 8] * factor;
+    }
+    else {
+        const uint8_t* row = &codes[j][static_cast<size_t>(entry) * nlang];
+        for(unsigned k = 0; k < nlang; k++) sum[k] += decode[row[k]] * factor;
+    }
+}
+
+/**
+ * @brief Returns bytes allocated by weight rows, entries and code rows
+ */
+size_t FrozenModel::memory_usage() const {
+    size_t bytes {decode.capacity() * sizeof(float)};
+    for(const vector<float>& rows : weights) bytes += rows.capacity() * sizeof(float);
+    for(const vector<uint32_t>& rows : entries) bytes += rows.capacity() * sizeof(uint32_t);
+    for(const vector<uint8_t>& rows : codes) bytes += rows.capacity();
+    return bytes;
+}
+
+const char* FrozenModel::precision_name(const Precision precision) {
+    switch(precision) {
+    case UINT16:
+        return "uint16";
+    case UINT8:
+        return "uint8";
+    default:
+        return "float32";
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef FROZENMODEL_H_INCLUDED
+#define FROZENMODEL_H_INCLUDED
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "patternstore.h"
+#include "scoring.h"
+#include "wordbook.h"
+
+using std::vector;
+
+/**
+ * @brief Read only inference model built from trained pattern stores
+ *
+ * Every pattern gets a row of normalized float weights (count / sum), so
+ * rating a word is a pure gather-and-sum. Scale only enters through one
+ * factor per pattern length, which makes rescaling O(1) per length.
+ * The tries of the pattern stores are used to find the patterns, their
+ * count rows aren't needed anymore and can be dropped. The stores aren't
+ * kept, callers pass the ones they froze on every use.
+ *
+ * Quantized precisions replace the float rows by one 32 bit entry per
+ * pattern. Patterns seen in a single language need nothing else, patterns
+ * seen in two languages keep the share of the first one as 16 bit fraction.
+ * All other patterns point to a row of 8 or 16 bit log-propability codes.
+ *
+ */
+class FrozenModel {
+public:
+    enum Precision { FLOAT32, UINT16, UINT8 };
+
+    /// Builds the weights of all patterns in mind
+    void freeze(const vector<PatternStore>& stores, const unsigned langs, const vector<double>& scales, const double def,
+                const Precision precision = FLOAT32);
+    /// Drops the weights
+    void clear();
+    /// True if frozen and not cleared since
+    bool ready() const { return built; }
+    /// Sets the scale of patterns with length plen
+    void rescale(const unsigned plen, const double value);
+    /// Takes over pattern stores grown by empty positions and a grown scale
+    void extend(const vector<PatternStore>& stores, const vector<double>& scales);
+
+    /// Rates a word like Brain::test_single on the frozen stores, returns the amount of patterns found
+    unsigned score(const vector<PatternStore>& stores, const Brainword& word, const unsigned max_pattern_len,
+                   vector<double>& scratch, double* ratings) const;
+
+    /// Bytes allocated by the weights
+    size_t memory_usage() const;
+    /// Precision of the weights
+    Precision get_precision() const { return precision; }
+    /// Name of a precision
+    static const char* precision_name(const Precision precision);
+
+private:
+    void freeze_float(const PatternStore& store, const unsigned j);
+    void freeze_quantized(const PatternStore& store, const unsigned j);
+    /// Log-propability code of p, 0 stands for p = 0
+    unsigned quantize(const double p) const;
+    /// Adds the weights of a quantized pattern
+    void add_quantized(double* sum, const unsigned j, const unsigned node, const double factor) const;
+
+    static const uint32_t TAG_MASK {3u << 30}; /// Kind of a quantized entry
+    static const uint32_t TAG_DENSE {0u << 30}; /// Index of a code row
+    static const uint32_t TAG_SINGLE {1u << 30}; /// Language index, p = 1
+    static const uint32_t TAG_PAIR {2u << 30}; /// Two language indices (7 bit each) and 16 bit share of the first
+
+
+    bool built {false}; /// Frozen and not cleared since
+    unsigned nlang {};
+    unsigned width {}; /// Padded length of a weight row
+    double def_rating {}; /// Weight of unknown patterns
+    vector<double> scale; /// Scale per pattern length
+    Precision precision {FLOAT32};
+    vector<vector<float>> weights; /// Weight rows per position, indexed by node (FLOAT32)
+    vector<vector<uint32_t>> entries; /// Entry per position and node (quantized)
+    vector<vector<uint8_t>> codes; /// Code rows per position, 1 or 2 bytes per language (quantized)
+    vector<float> decode; /// Propability per code (quantized)
+    double log_min {}; /// Log of the smallest propability with a code
+    WeightKernel kernel {select_weight_kernel()};
+};
+
+#endif // FROZENMODEL_H_INCLUDED
@@ -3,42 +3,61 @@
 #include <string>
 #include <fstream>
 #include <map>
+#include <memory>
 #include "wordbooks.h"
+#include "cli.h"
 #include <random>
 
 using namespace std;
 
-int main() {
+int main(int argc, char** argv) {
+    if(argc > 1) return run_cli(argc, argv);
 
     setlocale(LC_CTYPE, "en_US.utf8");
     cout << "Welcome to Leif's neuron based language recognizer with dynamically "
             "stacked pattern size. Everything should be quite self explanatory. "
             "Use 0 for unlimitied values. The bigger \"maxpattern\" is, the more"
             " accurate and memory consuming the process will be.\n\n";
-    unsigned minlength;
-    unsigned maxlength;
-    unsigned maxpattern;
-    unsigned langlength;
-    cout << "Minimum length of words: ";
-    cin >> minlength;
-    cout << "Maximum length of words: ";
-    cin >> maxlength;
-    cout << "Maximum pattern length: ";
-    cin >> maxpattern;
-    vector<string> namelist {"afr", "cze", "esp", "fre", "ger", "ita", "lat", "nla", "pol", "swe"};
-    //vector<string> namelist {"fre", "ger", "ita"}; // smaller default langlist
-    cout << "How many languages to learn?: ";
-    cin >>langlength;
-    if(langlength != 0) {
-        namelist.resize(langlength);
-        for(unsigned i = 0; i < langlength; i++) {
-            string lang;
-            cout << "Name of language file: ";
-            cin >> lang;
-            namelist[i] = lang;
+    string model;
+    cout << "Model file to load (0 to import wordbooks): ";
+    cin >> model;
+    unsigned threads;
+    cout << "Worker threads: ";
+    cin >> threads;
+    unique_ptr<Brain> brain;
+    if(model != "0") brain = make_unique<Brain>(model);
+    else {
+        unsigned minlength;
+        unsigned maxlength;
+        unsigned maxpattern;
+        unsigned langlength;
+        cout << "Minimum length of words: ";
+        cin >> minlength;
+        cout << "Maximum length of words: ";
+        cin >> maxlength;
+        cout << "Maximum pattern length: ";
+        cin >> maxpattern;
+        vector<string> namelist {DEFAULT_LANGS};
+        //vector<string> namelist {"fre", "ger", "ita"}; // smaller default langlist
+        cout << "How many languages to learn?: ";
+        cin >>langlength;
+        if(langlength != 0) {
+            namelist.resize(langlength);
+            for(unsigned i = 0; i < langlength; i++) {
+                string lang;
+                cout << "Name of language file: ";
+                cin >> lang;
+                namelist[i] = lang;
+            }
         }
+        string cache;
+        cout << "Wordbook cache file (0 for none): ";
+        cin >> cache;
+        if(cache != "0") Brain::wordbook_cache = cache;
+        brain = make_unique<Brain>(minlength, maxlength, namelist, maxpattern, threads);
     }
-    Brain Neurons(minlength, maxlength, namelist,maxpattern);
+    Brain& Neurons = *brain;
+    Neurons.threads = threads;
 
     while(true) {
         cout << "1 Train for x-times\n"
@@ -46,7 +65,9 @@ int main() {
                 "3 Ask for language of a single word\n"
                 "4 Get chances for word-slice\n"
                 "5 Pattern scaling, etc.\n"
-                "6 Exit\n";
+                "6 Print statistics as JSON\n"
+                "7 Compact model\n"
+                "8 Exit\n";
         char decide;
         cout << "Decision: ";
         cin >> decide;
@@ -91,13 +112,16 @@ int main() {
 
         case '5': {
                 char decide {'0'};
-                while(decide != '6') {
+                while(decide != '9') {
                     cout << "1 Evaluate and set optimal scaling\n"
                             "2 Print success per scaling steps\n"
                             "3 Manually set scaling values\n"
                             "4 Train on custom file\n"
                             "5 Test on custom file\n"
-                            "6 Return\n";
+                            "6 Training speed per thread count\n"
+                            "7 Save model to file\n"
+                            "8 Freeze model for faster testing\n"
+                            "9 Return\n";
                     cout << "Decision: ";
                     cin >> decide;
                     cout << "\n";
@@ -149,9 +173,11 @@ int main() {
                         cout << "Maximum pattern : ";
                         unsigned maxpattern;
                         cin >> maxpattern;
-                        for(unsigned i = minpattern; i <= maxpattern; i++) {
-                            cout << "Value for " << i << "-size patterns (old: " << Neurons.scale[i] << " ) : ";
-                            cin >> Neurons.scale[i];
+                        for(unsigned i = minpattern; i <= maxpattern && i <= Neurons.scale.size(); i++) {
+                            cout << "Value for " << i << "-size patterns (old: " << Neurons.scale[i - 1] << " ) : ";
+                            double value;
+                            cin >> value;
+                            Neurons.set_scale(i, value);
                         }
                         cout << "\n";
                         }break;
@@ -174,12 +200,52 @@ int main() {
                         cout << "File? (without .txt) : ";
                         string file;
                         cin >> file;
+                        cout << "Confidence to stop at (0 reads the whole file) : ";
+                        double confidence;
+                        cin >> confidence;
                         cout << "\n";
-                        Neurons.test_on_file(file);
+                        if(confidence > 0) Neurons.test_document(file, confidence);
+                        else Neurons.test_on_file(file);
                         cout << "\n";
                         }break;
 
                     case '6': {
+                        cout << "How many random words to train on? : ";
+                        unsigned train_words;
+                        cin >> train_words;
+                        cout << "\n";
+                        Neurons.train_scaling(train_words);
+                        cout << "\n";
+                        }break;
+
+                    case '7': {
+                        cout << "Model file? : ";
+                        string file;
+                        cin >> file;
+                        cout << "\n";
+                        Neurons.save_model(file);
+                        cout << "\n";
+                        }break;
+
+                    case '8': {
+                        cout << "Precision (1 float32, 2 uint16, 3 uint8, 4 compare all) : ";
+                        char precision;
+                        cin >> precision;
+                        cout << "\n";
+                        if(precision == '2') Neurons.freeze(FrozenModel::UINT16);
+                        else if(precision == '3') Neurons.freeze(FrozenModel::UINT8);
+                        else if(precision == '4') {
+                            cout << "Size of testing wordbook : ";
+                            unsigned wordcount;
+                            cin >> wordcount;
+                            cout << "\n";
+                            Neurons.compare_precisions(wordcount);
+                        }
+                        else Neurons.freeze();
+                        cout << "\n";
+                        }break;
+
+                    case '9': {
                         }break;
 
                     default: {
@@ -190,6 +256,29 @@ int main() {
             }break;
 
         case '6': {
+            cout << Neurons.stats_json() << "\n";
+            }break;
+
+        case '7': {
+            CompactOptions options;
+            cout << "Minimum count of patterns : ";
+            cin >> options.min_count;
+            cout << "Maximum entropy of patterns (1 keeps uniform ones) : ";
+            cin >> options.max_entropy;
+            cout << "Patterns kept per position (0 for all) : ";
+            cin >> options.top_k;
+            cout << "Size of testing wordbook : ";
+            unsigned wordcount;
+            cin >> wordcount;
+            cout << "Keep the compacted model? (y/n) : ";
+            char apply;
+            cin >> apply;
+            cout << "\n";
+            Neurons.compact(options, wordcount, apply == 'y');
+            cout << "\n";
+            }break;
+
+        case '8': {
             exit(0);
             }break;
 
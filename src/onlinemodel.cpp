@@ -0,0 +1,164 @@
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <algorithm>
+#include "parallel.h"
+#include "onlinemodel.h"
+
+using namespace std;
+
+/**
+ * @brief Copies Brain.mind into both copies
+ *
+ * Nothing is copied if Brain was frozen or compiled, the model only
+ * classifies through Brain then.
+ *
+ * @param brain Brain to train, its settings and Brain.mind are used
+ * @param publish_every Queued words which trigger a publish, 0 publishes on request only
+ *
+ */
+OnlineModel::OnlineModel(Brain& brain, const unsigned publish_every)
+: brain(brain), publish_every {publish_every}, counted {brain.has_counts("train online")}
+{
+    if(counted) {
+        copies[0] = brain.mind;
+        copies[1] = brain.mind;
+    }
+    readers[0].store(0);
+    readers[1].store(0);
+}
+
+/**
+ * @brief Queues a word, publishes once OnlineModel.publish_every words are queued
+ *
+ * @param word The word to train on
+ * @param lang_index The index of the language of the word
+ * @return False if the model isn't trainable and the word was dropped
+ *
+ */
+bool OnlineModel::train(const Brainword& word, const unsigned lang_index) {
+    if(!counted) return false;
+    size_t waiting {0};
+    {
+        lock_guard<mutex> lock(queue_mutex);
+        pending.push_back(word);
+        pending_langs.push_back(lang_index);
+        waiting = pending_langs.size();
+    }
+    if(publish_every != 0 && waiting >= publish_every) publish();
+    return true;
+}
+
+size_t OnlineModel::queued() const {
+    lock_guard<mutex> lock(queue_mutex);
+    return pending_langs.size();
+}
+
+/**
+ * @brief Trains the back copy on all queued words and publishes it
+ *
+ * Waits until the last reader left the back copy. Readers entering
+ * meanwhile see the published copy, so they don't hold up the writer.
+ * The back copy first catches up on the batch published before, then
+ * trains on the queued words. Counts match training all words in order.
+ * Decays scheduled by Brain.decay_every are applied after a batch and
+ * replayed along with it.
+ *
+ */
+void OnlineModel::publish() {
+    lock_guard<mutex> lock(publish_mutex);
+    Wordbook batch;
+    vector<unsigned> langs;
+    {
+        lock_guard<mutex> queue_lock(queue_mutex);
+        swap(batch, pending);
+        swap(langs, pending_langs);
+    }
+    if(langs.empty()) return;
+
+    const unsigned back = 1 - front.load();
+    while(readers[back].load() != 0) this_thread::yield();
+
+    const Stats::Timer timer(brain.stats, Stats::TRAIN_NS, Stats::TRAIN_BATCH);
+    brain.stats.add(Stats::WORDS_TRAINED, langs.size());
+    const unsigned workers = resolve_workers(brain.threads);
+    for(const Wordbook* words : {&replay, &batch}) {
+        vector<Brainword> views;
+        views.reserve(words->size());
+        for(size_t w = 0; w < words->size(); w++) views.push_back((*words)[w]);
+        brain.train_sharded(copies[back], views, words == &replay ? replay_langs : langs, workers);
+        if(words == &replay && replay_decay) brain.decay_stores(copies[back], brain.decay_factor);
+    }
+    trained_since_decay += langs.size();
+    replay_decay = brain.decay_every != 0 && trained_since_decay >= brain.decay_every;
+    if(replay_decay) {
+        trained_since_decay = 0;
+        brain.decay_stores(copies[back], brain.decay_factor);
+    }
+    front.store(back);
+    published.fetch_add(1);
+
+    replay = move(batch);
+    replay_langs = move(langs);
+}
+
+/**
+ * @brief Classifies a word on the published copy, or through Brain if not trainable
+ *
+ * A reader counts itself in on the copy it found published and checks it
+ * is still published, otherwise a writer may already work on it and the
+ * reader tries again on the new one.
+ *
+ * @param word Specified word to test
+ * @param scratch Buffer for ratings per pattern length, reused between calls
+ * @param ratings Receives the propabilities for each language
+ *
+ */
+void OnlineModel::classify(const Brainword& word, vector<double>& scratch, double* ratings) const {
+    if(!counted) {
+        brain.test_single(word, scratch, ratings);
+        return;
+    }
+    unsigned current = front.load();
+    for(;;) {
+        readers[current].fetch_add(1);
+        const unsigned now = front.load();
+        if(now == current) break;
+        readers[current].fetch_sub(1);
+        current = now;
+    }
+    brain.test_stores(copies[current], word, scratch, ratings);
+    readers[current].fetch_sub(1);
+}
+
+/**
+ * @brief Classifies a word on the published copy
+ * @param word Specified word to test
+ * @return Chosen language index and propabilities
+ *
+ */
+Classification OnlineModel::classify(const Brainword& word) const {
+    vector<double> scratch;
+    Classification result;
+    result.scores.resize(brain.nlang);
+    classify(word, scratch, &result.scores[0]);
+    result.label = max_element(result.scores.begin(), result.scores.end()) - result.scores.begin();
+    return result;
+}
+
+/**
+ * @brief Publishes queued words and hands the published copy to Brain.mind
+ *
+ * Neither Brain nor this model may be used by other threads meanwhile.
+ * Frozen and compiled models of Brain get dropped.
+ *
+ */
+void OnlineModel::commit() {
+    if(!counted) return;
+    publish();
+    brain.mind = copies[front.load()];
+    brain.frozen.clear();
+    brain.compiled.clear();
+}
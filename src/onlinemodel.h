@@ -0,0 +1,73 @@
+#ifndef ONLINEMODEL_H_INCLUDED
+#define ONLINEMODEL_H_INCLUDED
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+#include "patternstore.h"
+#include "wordbook.h"
+#include "wordbooks.h"
+
+using std::vector;
+
+/**
+ * @brief Keeps training a Brain while other threads classify
+ *
+ * Two copies of Brain.mind are kept (left-right scheme). Readers count
+ * themselves in on the published copy and only ever read it, writers
+ * queue words and publish them in batches: the back copy is brought up to
+ * date once its last reader left, then it becomes the published one.
+ * Readers never wait for writers and never see a half trained batch,
+ * growing a store or shrinking counts only happens in the back copy.
+ * Every published batch is replayed on the other copy with the next one.
+ *
+ * A frozen or compiled Brain holds no counts to train on. Words are
+ * rejected then and classify falls back to Brain.
+ *
+ * This is a library class, only get-lang-bench uses it so far. The
+ * command line and the server classify from a fixed Brain.
+ *
+ */
+class OnlineModel {
+public:
+    /// Copies Brain.mind twice, queued words get published every publish_every words (0 only by publish)
+    OnlineModel(Brain& brain, const unsigned publish_every = 10'000);
+
+    /// False if Brain.mind holds no counts, nothing can be trained then
+    bool trainable() const { return counted; }
+    /// Queues a word to train on, may publish, safe to call from any thread, false if not trainable
+    bool train(const Brainword& word, const unsigned lang_index);
+    /// Trains the back copy on all queued words and publishes it
+    void publish();
+    /// Classifies on the published copy, never blocks
+    Classification classify(const Brainword& word) const;
+    void classify(const Brainword& word, vector<double>& scratch, double* ratings) const;
+    /// Publishes queued words and writes the published copy to Brain.mind, Brain must not be in use
+    void commit();
+
+    /// Amount of published batches
+    uint64_t version() const { return published.load(); }
+    /// Amount of queued words not yet published
+    size_t queued() const;
+
+private:
+    Brain& brain;
+    const unsigned publish_every;
+    const bool counted; /// Brain.mind held counts when copied
+
+    vector<PatternStore> copies[2]; /// Both copies of Brain.mind
+    std::atomic<unsigned> front {0}; /// Index of the published copy
+    mutable std::atomic<int> readers[2]; /// Active readers per copy
+    std::atomic<uint64_t> published {0};
+
+    mutable std::mutex queue_mutex; /// Guards pending and pending_langs
+    Wordbook pending; /// Queued words
+    vector<unsigned> pending_langs;
+    std::mutex publish_mutex; /// Serializes publishing writers, guards the replay batch
+    Wordbook replay; /// Batch missing in the back copy
+    vector<unsigned> replay_langs;
+    bool replay_decay {false}; /// The back copy misses a decay after the replay batch
+    size_t trained_since_decay {0}; /// Words published since the last decay
+};
+
+#endif // ONLINEMODEL_H_INCLUDED
@@ -0,0 +1,27 @@
+#ifndef PARALLEL_H_INCLUDED
+#define PARALLEL_H_INCLUDED
+#include <vector>
+#include <thread>
+
+/**
+ * @brief Runs work(t) for every worker index t in [0, workers) and waits for all
+ *
+ * Worker 0 runs on the calling thread, so a single worker spawns no threads.
+ *
+ */
+template<typename Work>
+void run_workers(const unsigned workers, Work work) {
+    std::vector<std::thread> pool;
+    for(unsigned t = 1; t < workers; t++) pool.emplace_back(work, t);
+    work(0u);
+    for(std::thread& worker : pool) worker.join();
+}
+
+/// Worker count to use if 0 (all cores) is requested
+inline unsigned resolve_workers(const unsigned workers) {
+    if(workers != 0) return workers;
+    const unsigned cores = std::thread::hardware_concurrency();
+    return cores == 0 ? 1 : cores;
+}
+
+#endif // PARALLEL_H_INCLUDED
@@ -0,0 +1,368 @@
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include "snapshot.h"
+#include "scoring.h"
+#include "patternstore.h"
+
+using namespace std;
+
+const unsigned PatternStore::NIL;
+const unsigned PatternStore::NARROW_MAX;
+const unsigned PatternStore::PROMOTED;
+const unsigned PatternStore::WIDE_MAX;
+const unsigned PatternStore::FILTER_SLOTS;
+
+/**
+ * @brief Creates an empty store holding only the root node
+ * @param nlang Count of languages, defines the row stride
+ *
+ */
+PatternStore::PatternStore(const unsigned nlang)
+: stride {padded_width(nlang) + 1}, mask {15}, filter_mask {0}, own_keys(16, 0), own_nodes(16, 0), own_counts(stride, 0),
+own_filter(1, 0)
+{
+    attach();
+}
+
+PatternStore::PatternStore(const PatternStore& other)
+: stride {other.stride}, node_count {other.node_count}, wide_count {other.wide_count}, mask {other.mask},
+filter_mask {other.filter_mask}, keys {other.keys}, nodes {other.nodes}, counts {other.counts}, wide {other.wide},
+filter {other.filter}, dropped {other.dropped}, own_keys(other.own_keys), own_nodes(other.own_nodes), own_counts(other.own_counts),
+own_wide(other.own_wide), own_filter(other.own_filter), mapping(other.mapping)
+{
+    if(!mapping) attach();
+}
+
+PatternStore& PatternStore::operator=(const PatternStore& other) {
+    PatternStore copy(other);
+    return *this = move(copy);
+}
+
+/**
+ * @brief Looks up a slice by walking down from the root
+ * @param slice First char of the slice
+ * @param len Length of the slice
+ * @return Node of the slice or NIL
+ *
+ */
+unsigned PatternStore::find(const unsigned char* slice, const size_t len) const {
+    unsigned node = NIL;
+    for(size_t i = 0; i < len; i++) {
+        node = find(node, slice[i]);
+        if(node == NIL) break;
+    }
+    return node;
+}
+
+/**
+ * @brief Returns the child of a node, creates it if it doesn't exist yet
+ * @param parent Node to start from
+ * @param ch Char of the edge
+ * @return Child node
+ *
+ */
+unsigned PatternStore::insert(const unsigned parent, const unsigned char ch) {
+    if(mapping) detach();
+    const uint64_t key = pack(parent, ch);
+    const uint64_t hashed = hash(key);
+    uint64_t slot = hashed & mask;
+    for(; keys[slot] != 0; slot = (slot + 1) & mask) {
+        if(keys[slot] == key) return nodes[slot];
+    }
+    const unsigned node = node_count++;
+    keys[slot] = key;
+    nodes[slot] = node;
+    remember(hashed);
+    own_counts.resize(own_counts.size() + stride, 0);
+    counts = own_counts.data();
+    if(2 * static_cast<uint64_t>(node_count) > mask) grow();
+    return node;
+}
+
+/**
+ * @brief Doubles the slot count and rehashes all edges
+ *
+ * The filter is rebuilt along with the slots, it keeps one word per 16
+ * slots.
+ *
+ */
+void PatternStore::grow() {
+    vector<uint64_t> old_keys(2 * own_keys.size(), 0);
+    vector<unsigned> old_nodes(2 * own_nodes.size(), 0);
+    old_keys.swap(own_keys);
+    old_nodes.swap(own_nodes);
+    own_filter.assign(max<size_t>(own_keys.size() / FILTER_SLOTS, 1), 0);
+    attach();
+    mask = own_keys.size() - 1;
+    filter_mask = own_filter.size() - 1;
+    for(size_t i = 0; i < old_keys.size(); i++) {
+        if(old_keys[i] == 0) continue;
+        const uint64_t hashed = hash(old_keys[i]);
+        uint64_t slot = hashed & mask;
+        while(keys[slot] != 0) slot = (slot + 1) & mask;
+        keys[slot] = old_keys[i];
+        nodes[slot] = old_nodes[i];
+        remember(hashed);
+    }
+}
+
+/**
+ * @brief Moves the counts of a node into a new wide row
+ *
+ * The narrow row keeps PROMOTED as sum and the index of the wide row in
+ * the following two slots.
+ *
+ */
+void PatternStore::promote(const unsigned node) {
+    uint16_t* row = counts + static_cast<size_t>(node) * stride;
+    own_wide.insert(own_wide.end(), row, row + stride);
+    wide = own_wide.data();
+    const uint32_t index = wide_count++;
+    fill(row, row + stride, 0);
+    row[0] = PROMOTED;
+    memcpy(row + 1, &index, sizeof(index));
+}
+
+/**
+ * @brief Multiplies all counts by a factor
+ *
+ * Applied to every row at once, so relations between patterns stay as
+ * they were. Promoted rows stay wide. A slice is never counted more often
+ * than its prefix, so nodes dropping to zero have no counted children and
+ * are pruned. Nodes get renumbered if any are pruned.
+ *
+ * @param factor Factor between 0 and 1
+ *
+ */
+void PatternStore::decay(const double factor) {
+    if(mapping) detach();
+    const auto decay_row = [this, factor](auto* row) {
+        unsigned sum {0};
+        for(unsigned k = 1; k < stride; k++) {
+            row[k] = static_cast<unsigned>(row[k] * factor);
+            sum += row[k];
+        }
+        row[0] = sum;
+    };
+    for(unsigned node = 1; node < node_count; node++) {
+        uint16_t* row = counts + static_cast<size_t>(node) * stride;
+        if(row[0] != PROMOTED) decay_row(row);
+    }
+    for(size_t w = 0; w < wide_count; w++) decay_row(wide + w * stride);
+
+    vector<bool> keep(node_count, true);
+    bool dropped {false};
+    for(unsigned node = 1; node < node_count; node++) {
+        keep[node] = count(node, 0) != 0;
+        dropped |= !keep[node];
+    }
+    if(dropped) prune(keep);
+}
+
+/**
+ * @brief Drops the count rows, only the trie edges and the filter stay
+ *
+ * Pages of mapped rows are dropped from memory as well.
+ *
+ */
+void PatternStore::drop_counts() {
+    if(mapping) {
+        mapping->release(counts, static_cast<size_t>(node_count) * stride * sizeof(uint16_t));
+        mapping->release(wide, static_cast<size_t>(wide_count) * stride * sizeof(unsigned));
+    }
+    vector<uint16_t>().swap(own_counts);
+    vector<unsigned>().swap(own_wide);
+    counts = nullptr;
+    wide = nullptr;
+    wide_count = 0;
+    dropped = true;
+}
+
+/**
+ * @brief Points the arrays to the owned vectors
+ */
+void PatternStore::attach() {
+    keys = own_keys.data();
+    nodes = own_nodes.data();
+    counts = own_counts.data();
+    wide = own_wide.data();
+    filter = own_filter.data();
+}
+
+/**
+ * @brief Copies mapped arrays into owned vectors and drops the mapping
+ */
+void PatternStore::detach() {
+    own_keys.assign(keys, keys + mask + 1);
+    own_nodes.assign(nodes, nodes + mask + 1);
+    own_counts.assign(counts, counts + static_cast<size_t>(node_count) * stride);
+    own_wide.assign(wide, wide + static_cast<size_t>(wide_count) * stride);
+    own_filter.assign(filter, filter + filter_mask + 1);
+    mapping.reset();
+    attach();
+}
+
+/**
+ * @brief Counts stored slices per length
+ *
+ * Parents are always created before their children, so the depth of every
+ * node is known once its parent is done.
+ *
+ */
+vector<size_t> PatternStore::count_per_length() const {
+    const vector<unsigned> parent = parents();
+    vector<unsigned> depth(node_count, 0);
+    vector<size_t> counts_per_length;
+    for(unsigned node = 1; node < node_count; node++) {
+        depth[node] = depth[parent[node]] + 1;
+        if(counts_per_length.size() < depth[node]) counts_per_length.resize(depth[node], 0);
+        counts_per_length[depth[node] - 1]++;
+    }
+    return counts_per_length;
+}
+
+/**
+ * @brief Returns the parent of every node, read from the packed keys
+ */
+vector<unsigned> PatternStore::parents() const {
+    vector<unsigned> parent(node_count, NIL);
+    for(uint64_t slot = 0; slot <= mask; slot++) {
+        if(keys[slot] != 0) parent[nodes[slot]] = (keys[slot] - 1) >> 8;
+    }
+    return parent;
+}
+
+/**
+ * @brief Returns the char of the edge leading to every node, read from the packed keys
+ */
+vector<unsigned char> PatternStore::labels() const {
+    vector<unsigned char> label(node_count, 0);
+    for(uint64_t slot = 0; slot <= mask; slot++) {
+        if(keys[slot] != 0) label[nodes[slot]] = (keys[slot] - 1) & 0xFF;
+    }
+    return label;
+}
+
+/**
+ * @brief Rebuilds the store with a subset of its nodes
+ *
+ * Kept nodes get renumbered in their old order, so parents still come
+ * before their children. Slots are sized for the kept nodes only.
+ *
+ * @param keep Flag per node, the parent of every kept node has to be kept as well
+ *
+ */
+void PatternStore::prune(const vector<bool>& keep) {
+    PatternStore pruned(0);
+    pruned.stride = stride;
+    pruned.own_counts.assign(stride, 0);
+    pruned.attach();
+    vector<unsigned> renumbered(node_count, NIL);
+    vector<unsigned> parent(node_count, NIL);
+    vector<unsigned char> edge(node_count, 0);
+    for(uint64_t slot = 0; slot <= mask; slot++) {
+        if(keys[slot] == 0) continue;
+        parent[nodes[slot]] = (keys[slot] - 1) >> 8;
+        edge[nodes[slot]] = (keys[slot] - 1) & 0xFF;
+    }
+    for(unsigned node = 1; node < node_count; node++) {
+        if(!keep[node]) continue;
+        renumbered[node] = pruned.insert(renumbered[parent[node]], edge[node]);
+        const uint16_t* row = narrow_row(node);
+        uint16_t* pruned_row = pruned.counts + static_cast<size_t>(renumbered[node]) * stride;
+        if(const unsigned* rates = wide_row(node)) {
+            pruned.own_wide.insert(pruned.own_wide.end(), rates, rates + stride);
+            pruned.wide = pruned.own_wide.data();
+            const uint32_t index = pruned.wide_count++;
+            pruned_row[0] = PROMOTED;
+            memcpy(pruned_row + 1, &index, sizeof(index));
+        }
+        else copy(row, row + stride, pruned_row);
+    }
+    pruned.own_counts.shrink_to_fit();
+    pruned.attach();
+    *this = move(pruned);
+}
+
+/**
+ * @brief Returns bytes of slots, filter and count rows, including mapped ones
+ */
+size_t PatternStore::footprint() const {
+    return (mask + 1) * (sizeof(uint64_t) + sizeof(unsigned)) + (filter_mask + 1) * sizeof(uint64_t) + count_bytes();
+}
+
+/**
+ * @brief Returns bytes of narrow and wide count rows, including mapped ones
+ */
+size_t PatternStore::count_bytes() const {
+    if(dropped) return 0;
+    return static_cast<size_t>(node_count) * stride * sizeof(uint16_t) + static_cast<size_t>(wide_count) * stride * sizeof(unsigned);
+}
+
+/**
+ * @brief Returns bytes allocated by slots, filter and count rows
+ */
+size_t PatternStore::memory_usage() const {
+    return own_keys.capacity() * sizeof(uint64_t) + own_nodes.capacity() * sizeof(unsigned)
+        + own_counts.capacity() * sizeof(uint16_t) + own_wide.capacity() * sizeof(unsigned)
+        + own_filter.capacity() * sizeof(uint64_t);
+}
+
+/**
+ * @brief Writes row stride, sizes and the raw arrays
+ *
+ * The filter is saved as well, so mapped stores don't have to rebuild it.
+ *
+ */
+void PatternStore::save(SnapshotWriter& writer) const {
+    writer.put<uint32_t>(stride);
+    writer.put<uint32_t>(node_count);
+    writer.put<uint32_t>(wide_count);
+    writer.put<uint64_t>(mask + 1);
+    writer.put_array(keys, mask + 1);
+    writer.put_array(nodes, mask + 1);
+    writer.put_array(counts, static_cast<size_t>(node_count) * stride);
+    writer.put_array(wide, static_cast<size_t>(wide_count) * stride);
+    writer.put_array(filter, filter_mask + 1);
+}
+
+/**
+ * @brief Points the store to arrays inside a mapped snapshot
+ * @param reader Reader positioned at a store written by PatternStore::save
+ * @return False if the snapshot is broken or doesn't fit the row stride
+ *
+ */
+bool PatternStore::map(SnapshotReader& reader) {
+    const uint32_t file_stride = reader.get<uint32_t>();
+    const uint32_t file_nodes = reader.get<uint32_t>();
+    const uint32_t file_wide = reader.get<uint32_t>();
+    const uint64_t slots = reader.get<uint64_t>();
+    if(!reader.good() || file_stride != stride || slots == 0 || (slots & (slots - 1)) != 0) return false;
+    const uint64_t* file_keys = reader.get_array<uint64_t>(slots);
+    const unsigned* slot_nodes = reader.get_array<unsigned>(slots);
+    const uint16_t* file_counts = reader.get_array<uint16_t>(static_cast<size_t>(file_nodes) * stride);
+    const unsigned* file_rows = reader.get_array<unsigned>(static_cast<size_t>(file_wide) * stride);
+    const uint64_t filter_words = max<uint64_t>(slots / FILTER_SLOTS, 1);
+    const uint64_t* file_filter = reader.get_array<uint64_t>(filter_words);
+    if(!reader.good()) return false;
+
+    node_count = file_nodes;
+    wide_count = file_wide;
+    mask = slots - 1;
+    filter_mask = filter_words - 1;
+    keys = const_cast<uint64_t*>(file_keys);
+    nodes = const_cast<unsigned*>(slot_nodes);
+    counts = const_cast<uint16_t*>(file_counts);
+    wide = const_cast<unsigned*>(file_rows);
+    filter = const_cast<uint64_t*>(file_filter);
+    vector<uint64_t>().swap(own_keys);
+    vector<unsigned>().swap(own_nodes);
+    vector<uint16_t>().swap(own_counts);
+    vector<unsigned>().swap(own_wide);
+    vector<uint64_t>().swap(own_filter);
+    mapping = reader.mapping();
+    return true;
+}
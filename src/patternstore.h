@@ -0,0 +1,200 @@
+#ifndef PATTERNSTORE_H_INCLUDED
+#define PATTERNSTORE_H_INCLUDED
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include "snapshot.h"
+
+using std::vector;
+
+/**
+ * @brief Flat pattern store of one word position
+ *
+ * Slices are kept in a trie whose edges (parent node, char) live in an
+ * open-addressing hash table with packed 64 bit keys. Every node owns one
+ * row of the contiguous counts array, row layout is [sum, lang_0 ... lang_n-1]
+ * followed by zeroes up to the padded width of the scoring kernels.
+ *
+ * Counts are 16 bit. A row whose sum outgrows them is promoted to a 32 bit
+ * row of the wide array, its narrow row then holds PROMOTED as sum and
+ * the index of the wide row. Only the few short and frequent slices of a
+ * position ever get promoted.
+ *
+ * Every edge also sets four bits in one 64 bit word of a small Bloom
+ * filter, about four bits per slot. Lookups of absent slices, the common
+ * case for long patterns, are mostly rejected there and never touch the
+ * much larger slot arrays.
+ *
+ * Node 0 is the root (empty slice). As the root is never a child, 0 is
+ * also returned on failed lookups.
+ *
+ * A store can also be served straight from a mapped snapshot. The arrays
+ * are copied into memory of its own on the first change.
+ *
+ * Once a FrozenModel holds the weights, the count rows can be dropped and
+ * only the trie is left for finding patterns.
+ *
+ */
+class PatternStore {
+public:
+    explicit PatternStore(const unsigned nlang = 0);
+    PatternStore(const PatternStore& other);
+    PatternStore(PatternStore&& other) = default;
+    PatternStore& operator=(const PatternStore& other);
+    PatternStore& operator=(PatternStore&& other) = default;
+
+    /// Child of node reached over ch, or NIL
+    unsigned find(const unsigned parent, const unsigned char ch) const {
+        const uint64_t key = pack(parent, ch);
+        const uint64_t hashed = hash(key);
+        if(!may_contain(hashed)) return NIL;
+        for(uint64_t slot = hashed & mask; keys[slot] != 0; slot = (slot + 1) & mask) {
+            if(keys[slot] == key) return nodes[slot];
+        }
+        return NIL;
+    }
+    /// False if the edge is surely absent, true if it may exist
+    bool may_contain(const unsigned parent, const unsigned char ch) const { return may_contain(hash(pack(parent, ch))); }
+    /// Node of a full slice, or NIL
+    unsigned find(const unsigned char* slice, const size_t len) const;
+    /// Child of node reached over ch, created with zero counts if missing
+    unsigned insert(const unsigned parent, const unsigned char ch);
+
+    /// 16 bit count row of node, only holds counts unless promoted
+    const uint16_t* narrow_row(const unsigned node) const { return counts + static_cast<size_t>(node) * stride; }
+    /// 32 bit count row of a promoted node, nullptr if node isn't promoted
+    const unsigned* wide_row(const unsigned node) const {
+        const uint16_t* row = narrow_row(node);
+        if(row[0] != PROMOTED) return nullptr;
+        uint32_t index;
+        std::memcpy(&index, row + 1, sizeof(index));
+        return wide + static_cast<size_t>(index) * stride;
+    }
+    /// Entry k of the count row of node, 0 is the sum
+    unsigned count(const unsigned node, const unsigned k) const {
+        const unsigned* row = wide_row(node);
+        return row ? row[k] : narrow_row(node)[k];
+    }
+    /// Counts weight hits of a language, false if the row would saturate and nothing was counted
+    bool add(const unsigned node, const unsigned lang_index, const unsigned weight = 1) {
+        if(mapping) detach();
+        uint16_t* row = counts + static_cast<size_t>(node) * stride;
+        if(row[0] != PROMOTED) {
+            if(row[0] + weight <= NARROW_MAX) {
+                row[0] += weight;
+                row[lang_index + 1] += weight;
+                return true;
+            }
+            promote(node);
+        }
+        unsigned* rates = const_cast<unsigned*>(wide_row(node));
+        if(rates[0] > WIDE_MAX - weight) return false;
+        rates[0] += weight;
+        rates[lang_index + 1] += weight;
+        return true;
+    }
+    /// Takes back weight hits of a language counted by add
+    void subtract(const unsigned node, const unsigned lang_index, const unsigned weight = 1) {
+        if(mapping) detach();
+        uint16_t* row = counts + static_cast<size_t>(node) * stride;
+        if(row[0] != PROMOTED) {
+            row[0] -= weight;
+            row[lang_index + 1] -= weight;
+            return;
+        }
+        unsigned* rates = const_cast<unsigned*>(wide_row(node));
+        rates[0] -= weight;
+        rates[lang_index + 1] -= weight;
+    }
+    /// Multiplies all counts by factor (rounded down), drops nodes reaching zero
+    void decay(const double factor);
+    /// Amount of promoted rows
+    size_t promoted() const { return wide_count; }
+    /// Drops all count rows, the store can't count or rate anymore
+    void drop_counts();
+    /// False once the count rows were dropped
+    bool counted() const { return !dropped; }
+
+    /// Amount of stored slices (root excluded)
+    size_t size() const { return node_count - 1; }
+    /// Amount of stored slices per length, index 0 holds length 1
+    vector<size_t> count_per_length() const;
+    /// Bytes allocated by the store, mapped arrays excluded
+    size_t memory_usage() const;
+    /// Bytes of slots, filter and count rows, mapped or not
+    size_t footprint() const;
+    /// Bytes of narrow and wide count rows, mapped or not, 0 once dropped
+    size_t count_bytes() const;
+    /// Parent of every node, the root is its own parent
+    vector<unsigned> parents() const;
+    /// Char of the edge leading to every node, 0 for the root
+    vector<unsigned char> labels() const;
+    /// Rebuilds the store with the nodes marked in keep, which has to be prefix closed
+    void prune(const vector<bool>& keep);
+
+    /// Writes the store to a snapshot
+    void save(SnapshotWriter& writer) const;
+    /// Serves the store from the arrays of a snapshot without copying them
+    bool map(SnapshotReader& reader);
+
+    static const unsigned NIL = 0; /// Root node and lookup failure
+    static const unsigned NARROW_MAX = 0xFFFE; /// Largest sum of a narrow row
+    static const unsigned PROMOTED = 0xFFFF; /// Sum of a narrow row marking a promoted node
+    static const unsigned WIDE_MAX = 0xFFFFFFFF; /// Largest sum of a promoted row
+
+private:
+    static const unsigned FILTER_SLOTS = 16; /// Slots per filter word, about four filter bits per slot
+
+    /// Packs an edge into a hash key, 0 marks an empty slot
+    static uint64_t pack(const unsigned parent, const unsigned char ch) {
+        return ((static_cast<uint64_t>(parent) << 8) | ch) + 1;
+    }
+    static uint64_t hash(uint64_t key) {
+        key ^= key >> 30;
+        key *= 0xbf58476d1ce4e5b9ULL;
+        key ^= key >> 27;
+        key *= 0x94d049bb133111ebULL;
+        key ^= key >> 31;
+        return key;
+    }
+    /// Filter bits of a hashed edge, word index comes from the upper half
+    static uint64_t filter_bits(const uint64_t hashed) {
+        return (1ULL << (hashed & 63)) | (1ULL << ((hashed >> 6) & 63))
+            | (1ULL << ((hashed >> 12) & 63)) | (1ULL << ((hashed >> 18) & 63));
+    }
+    bool may_contain(const uint64_t hashed) const {
+        const uint64_t bits = filter_bits(hashed);
+        return (filter[(hashed >> 32) & filter_mask] & bits) == bits;
+    }
+    /// Sets the filter bits of a hashed edge
+    void remember(const uint64_t hashed) { filter[(hashed >> 32) & filter_mask] |= filter_bits(hashed); }
+    void grow();
+    /// Moves the counts of a node into a new wide row
+    void promote(const unsigned node);
+    /// Points the arrays to the owned vectors
+    void attach();
+    /// Copies mapped arrays into owned vectors
+    void detach();
+
+    unsigned stride; /// Length of one count row (padded nlang + 1)
+    unsigned node_count {1}; /// Nodes in use, including root
+    unsigned wide_count {0}; /// Promoted rows
+    uint64_t mask {}; /// Slot count - 1
+    uint64_t filter_mask {}; /// Filter word count - 1
+    uint64_t* keys {}; /// Packed edges per slot
+    unsigned* nodes {}; /// Child node per slot
+    uint16_t* counts {}; /// Narrow count rows of all nodes
+    unsigned* wide {}; /// Wide count rows of promoted nodes
+    uint64_t* filter {}; /// Bloom filter words over all edges
+    bool dropped {false}; /// True once the count rows were dropped
+    vector<uint64_t> own_keys; /// Storage of keys unless mapped
+    vector<unsigned> own_nodes; /// Storage of nodes unless mapped
+    vector<uint16_t> own_counts; /// Storage of counts unless mapped
+    vector<unsigned> own_wide; /// Storage of wide rows unless mapped
+    vector<uint64_t> own_filter; /// Storage of filter unless mapped
+    std::shared_ptr<const MappedFile> mapping; /// Snapshot the arrays point into
+};
+
+#endif // PATTERNSTORE_H_INCLUDED
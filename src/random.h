@@ -0,0 +1,47 @@
+#ifndef RANDOM_H_INCLUDED
+#define RANDOM_H_INCLUDED
+#include <random>
+#include <chrono>
+#include <cstdint>
+
+/**
+ * @brief Independent random streams per phase, all derived from one seed
+ *
+ * Training, testing and the trial pool draw from generators of their own,
+ * so the words of one phase don't depend on how many were drawn by the
+ * others. Every stream is seeded with splitmix64 of the seed and its
+ * number, the same seed always reproduces the same draws.
+ *
+ */
+class RandomStreams {
+public:
+    enum Phase { TRAIN, TEST, TRIAL, PHASES };
+    typedef std::minstd_rand Generator;
+
+    explicit RandomStreams(const uint64_t seed = 0) { reseed(seed); }
+
+    /// Restarts all streams from a new seed
+    void reseed(const uint64_t seed) {
+        base = seed;
+        for(unsigned p = 0; p < PHASES; p++) streams[p].seed(mix(seed + p + 1) % Generator::modulus);
+    }
+    uint64_t seed() const { return base; }
+    /// Seed from the current time, used unless a seed is given
+    static uint64_t clock_seed() { return std::chrono::system_clock::now().time_since_epoch().count(); }
+    /// Generator of a phase
+    Generator& operator[](const Phase phase) { return streams[phase]; }
+
+private:
+    /// splitmix64 finalizer, spreads neighbouring stream numbers apart
+    static uint64_t mix(uint64_t value) {
+        value += 0x9e3779b97f4a7c15ULL;
+        value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+        return value ^ (value >> 31);
+    }
+
+    uint64_t base {0};
+    Generator streams[PHASES];
+};
+
+#endif // RANDOM_H_INCLUDED
@@ -0,0 +1,88 @@
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include "parallel.h"
+#include "scaletuner.h"
+
+using namespace std;
+
+/**
+ * @brief Reserves the terms of all words
+ *
+ * @param langs Count of languages
+ * @param plens Amount of pattern lengths per word
+ * @param labels Language index per word
+ * @param workers Worker threads used to evaluate scale values
+ *
+ */
+ScaleTuner::ScaleTuner(const unsigned langs, const vector<unsigned>& plens, const vector<unsigned>& labels, const unsigned workers)
+: nlang {langs}, workers {max(workers, 1u)}, first(plens.size() + 1, 0), labels(labels)
+{
+    for(size_t w = 0; w < plens.size(); w++) first[w + 1] = first[w] + plens[w];
+    values.assign(first.back() * nlang, 0);
+}
+
+/**
+ * @brief Returns the success rate with given scale
+ * @param scale Scale per pattern length
+ * @return Success rate in percent
+ *
+ */
+double ScaleTuner::success(const vector<double>& scale) const {
+    const vector<vector<double>> rates = sweep(scale, {1}, {scale[0]});
+    return rates[0][0];
+}
+
+/**
+ * @brief Tests candidate values for several pattern lengths in one pass
+ *
+ * Workers grab chunks of words. Per word and pattern length the parts of
+ * all other lengths are summed up once, then every candidate adds its own
+ * part and picks the best language like Brain::classify_batch.
+ *
+ * @param scale Scale per pattern length
+ * @param plens Pattern lengths (from 1) to vary, one at a time
+ * @param candidates Values tried for each of them
+ * @return Success rate in percent per pattern length and candidate
+ *
+ */
+vector<vector<double>> ScaleTuner::sweep(const vector<double>& scale, const vector<unsigned>& plens, const vector<double>& candidates) const {
+    const size_t chunk {256};
+    vector<vector<unsigned>> hits(workers, vector<unsigned>(plens.size() * candidates.size(), 0));
+    atomic<size_t> next {0};
+    run_workers(workers, [&](unsigned t) {
+        vector<double> base(nlang);
+        vector<double> rating(nlang);
+        for(size_t begin = next.fetch_add(chunk); begin < labels.size(); begin = next.fetch_add(chunk)) {
+            const size_t end = min(begin + chunk, labels.size());
+            for(size_t w = begin; w < end; w++) {
+                const unsigned word_plen = first[w + 1] - first[w];
+                const double* rows = &values[first[w] * nlang];
+                for(size_t p = 0; p < plens.size(); p++) {
+                    fill(base.begin(), base.end(), 0);
+                    for(unsigned i = 1; i <= word_plen; i++) {
+                        if(i == plens[p]) continue;
+                        for(unsigned k = 0; k < nlang; k++) base[k] += scale[i - 1] * rows[(i - 1) * nlang + k] + 0.5;
+                    }
+                    const double* varied = plens[p] <= word_plen ? rows + (plens[p] - 1) * nlang : nullptr;
+                    for(size_t c = 0; c < candidates.size(); c++) {
+                        for(unsigned k = 0; k < nlang; k++) {
+                            rating[k] = varied ? base[k] + candidates[c] * varied[k] + 0.5 : base[k];
+                        }
+                        const unsigned label = max_element(rating.begin(), rating.end()) - rating.begin();
+                        if(label == labels[w]) hits[t][p * candidates.size() + c]++;
+                    }
+                }
+            }
+        }
+    });
+    vector<vector<double>> rates(plens.size(), vector<double>(candidates.size(), 0));
+    for(size_t p = 0; p < plens.size(); p++) {
+        for(size_t c = 0; c < candidates.size(); c++) {
+            unsigned sum {0};
+            for(unsigned t = 0; t < workers; t++) sum += hits[t][p * candidates.size() + c];
+            rates[p][c] = labels.empty() ? 0 : 100.0 * sum / labels.size();
+        }
+    }
+    return rates;
+}
@@ -0,0 +1,41 @@
+#ifndef SCALETUNER_H_INCLUDED
+#define SCALETUNER_H_INCLUDED
+#include <vector>
+#include <cstddef>
+
+using std::vector;
+
+/**
+ * @brief Evaluates scale values on cached pattern ratings of trial words
+ *
+ * Brain::test_single rates language k of a word as
+ * sum over pattern lengths i of scale[i] * (R_ik / (n - i + 1) - 0.5) + 0.5,
+ * divided by the amount of lengths. The terms in brackets don't depend on
+ * the scale, so they are cached once per word and length. Parts added for
+ * the unchanged lengths are summed once per word, every candidate value
+ * then only costs one multiply-add per language.
+ *
+ */
+class ScaleTuner {
+public:
+    /// Reserves terms for words with given amounts of pattern lengths and languages
+    ScaleTuner(const unsigned langs, const vector<unsigned>& plens, const vector<unsigned>& labels, const unsigned workers);
+
+    /// Terms of pattern length i (from 1) of word w, to be filled before evaluating
+    double* terms(const size_t w, const unsigned i) { return &values[(first[w] + i - 1) * nlang]; }
+    size_t size() const { return labels.size(); }
+
+    /// Success rate in percent with given scale
+    double success(const vector<double>& scale) const;
+    /// Success rates per pattern length in plens and candidate value, other lengths keep their scale
+    vector<vector<double>> sweep(const vector<double>& scale, const vector<unsigned>& plens, const vector<double>& candidates) const;
+
+private:
+    const unsigned nlang;
+    const unsigned workers;
+    vector<size_t> first; /// First term row per word, plus the end of the last word
+    vector<unsigned> labels; /// Language index per word
+    vector<double> values; /// nlang terms per word and pattern length
+};
+
+#endif // SCALETUNER_H_INCLUDED
@@ -0,0 +1,169 @@
+#include "scoring.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCORING_X86
+#include <immintrin.h>
+#endif
+
+/**
+ * @brief Portable kernel, also used on cpus without vector support
+ */
+static void score_scalar(double* ratings, const unsigned* counts, const unsigned width, const double factor) {
+    for(unsigned k = 0; k < width; k++) ratings[k] += counts[k] * factor;
+}
+
+/**
+ * @brief Portable kernel for 16 bit counts
+ */
+static void score_narrow_scalar(double* ratings, const uint16_t* counts, const unsigned width, const double factor) {
+    for(unsigned k = 0; k < width; k++) ratings[k] += counts[k] * factor;
+}
+
+/**
+ * @brief Portable kernel for normalized weights
+ */
+static void weigh_scalar(double* ratings, const float* weights, const unsigned width, const double factor) {
+    for(unsigned k = 0; k < width; k++) ratings[k] += weights[k] * factor;
+}
+
+#ifdef SCORING_X86
+/**
+ * @brief Kernel using two doubles per operation
+ *
+ * Counts are unsigned, so they get flipped into signed range before the
+ * conversion and shifted back as doubles.
+ *
+ */
+__attribute__((target("sse2")))
+static void score_sse2(double* ratings, const unsigned* counts, const unsigned width, const double factor) {
+    const __m128i flip = _mm_set1_epi32(0x80000000);
+    const __m128d offset = _mm_set1_pd(2147483648.0);
+    const __m128d scale = _mm_set1_pd(factor);
+    for(unsigned k = 0; k < width; k += 4) {
+        const __m128i raw = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(counts + k)), flip);
+        const __m128d low = _mm_add_pd(_mm_cvtepi32_pd(raw), offset);
+        const __m128d high = _mm_add_pd(_mm_cvtepi32_pd(_mm_srli_si128(raw, 8)), offset);
+        _mm_storeu_pd(ratings + k, _mm_add_pd(_mm_loadu_pd(ratings + k), _mm_mul_pd(low, scale)));
+        _mm_storeu_pd(ratings + k + 2, _mm_add_pd(_mm_loadu_pd(ratings + k + 2), _mm_mul_pd(high, scale)));
+    }
+}
+
+/**
+ * @brief Kernel using four doubles per operation
+ */
+__attribute__((target("avx2")))
+static void score_avx2(double* ratings, const unsigned* counts, const unsigned width, const double factor) {
+    const __m128i flip = _mm_set1_epi32(0x80000000);
+    const __m256d offset = _mm256_set1_pd(2147483648.0);
+    const __m256d scale = _mm256_set1_pd(factor);
+    for(unsigned k = 0; k < width; k += 4) {
+        const __m128i raw = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(counts + k)), flip);
+        const __m256d values = _mm256_add_pd(_mm256_cvtepi32_pd(raw), offset);
+        _mm256_storeu_pd(ratings + k, _mm256_add_pd(_mm256_loadu_pd(ratings + k), _mm256_mul_pd(values, scale)));
+    }
+}
+
+/**
+ * @brief Kernel for 16 bit counts using two doubles per operation
+ *
+ * Counts are zero extended to 32 bit, so no flipping is needed.
+ *
+ */
+__attribute__((target("sse2")))
+static void score_narrow_sse2(double* ratings, const uint16_t* counts, const unsigned width, const double factor) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128d scale = _mm_set1_pd(factor);
+    for(unsigned k = 0; k < width; k += 4) {
+        const __m128i raw = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(counts + k)), zero);
+        const __m128d low = _mm_cvtepi32_pd(raw);
+        const __m128d high = _mm_cvtepi32_pd(_mm_srli_si128(raw, 8));
+        _mm_storeu_pd(ratings + k, _mm_add_pd(_mm_loadu_pd(ratings + k), _mm_mul_pd(low, scale)));
+        _mm_storeu_pd(ratings + k + 2, _mm_add_pd(_mm_loadu_pd(ratings + k + 2), _mm_mul_pd(high, scale)));
+    }
+}
+
+/**
+ * @brief Kernel for 16 bit counts using four doubles per operation
+ */
+__attribute__((target("avx2")))
+static void score_narrow_avx2(double* ratings, const uint16_t* counts, const unsigned width, const double factor) {
+    const __m256d scale = _mm256_set1_pd(factor);
+    for(unsigned k = 0; k < width; k += 4) {
+        const __m128i raw = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(counts + k)));
+        const __m256d values = _mm256_cvtepi32_pd(raw);
+        _mm256_storeu_pd(ratings + k, _mm256_add_pd(_mm256_loadu_pd(ratings + k), _mm256_mul_pd(values, scale)));
+    }
+}
+
+/**
+ * @brief Weight kernel using two doubles per operation
+ */
+__attribute__((target("sse2")))
+static void weigh_sse2(double* ratings, const float* weights, const unsigned width, const double factor) {
+    const __m128d scale = _mm_set1_pd(factor);
+    for(unsigned k = 0; k < width; k += 4) {
+        const __m128 raw = _mm_loadu_ps(weights + k);
+        const __m128d low = _mm_cvtps_pd(raw);
+        const __m128d high = _mm_cvtps_pd(_mm_movehl_ps(raw, raw));
+        _mm_storeu_pd(ratings + k, _mm_add_pd(_mm_loadu_pd(ratings + k), _mm_mul_pd(low, scale)));
+        _mm_storeu_pd(ratings + k + 2, _mm_add_pd(_mm_loadu_pd(ratings + k + 2), _mm_mul_pd(high, scale)));
+    }
+}
+
+/**
+ * @brief Weight kernel using four doubles per operation
+ */
+__attribute__((target("avx2")))
+static void weigh_avx2(double* ratings, const float* weights, const unsigned width, const double factor) {
+    const __m256d scale = _mm256_set1_pd(factor);
+    for(unsigned k = 0; k < width; k += 4) {
+        const __m256d values = _mm256_cvtps_pd(_mm_loadu_ps(weights + k));
+        _mm256_storeu_pd(ratings + k, _mm256_add_pd(_mm256_loadu_pd(ratings + k), _mm256_mul_pd(values, scale)));
+    }
+}
+#endif
+
+/**
+ * @brief Picks the fastest kernel supported by the running cpu
+ */
+ScoreKernel select_score_kernel() {
+#ifdef SCORING_X86
+    if(__builtin_cpu_supports("avx2")) return score_avx2;
+    if(__builtin_cpu_supports("sse2")) return score_sse2;
+#endif
+    return score_scalar;
+}
+
+/**
+ * @brief Picks the fastest kernel for 16 bit counts supported by the running cpu
+ */
+NarrowKernel select_narrow_kernel() {
+#ifdef SCORING_X86
+    if(__builtin_cpu_supports("avx2")) return score_narrow_avx2;
+    if(__builtin_cpu_supports("sse2")) return score_narrow_sse2;
+#endif
+    return score_narrow_scalar;
+}
+
+/**
+ * @brief Picks the fastest weight kernel supported by the running cpu
+ */
+WeightKernel select_weight_kernel() {
+#ifdef SCORING_X86
+    if(__builtin_cpu_supports("avx2")) return weigh_avx2;
+    if(__builtin_cpu_supports("sse2")) return weigh_sse2;
+#endif
+    return weigh_scalar;
+}
+
+/**
+ * @brief Names the kernel picked by select_score_kernel
+ */
+const char* score_kernel_name() {
+    const ScoreKernel kernel = select_score_kernel();
+#ifdef SCORING_X86
+    if(kernel == score_avx2) return "avx2";
+    if(kernel == score_sse2) return "sse2";
+#endif
+    return kernel == score_scalar ? "scalar" : "unknown";
+}
@@ -0,0 +1,37 @@
+#ifndef SCORING_H_INCLUDED
+#define SCORING_H_INCLUDED
+#include <cstdint>
+
+/**
+ * Kernels accumulating language propabilities of one pattern hit, either
+ * from raw counts or from normalized weights of a frozen model.
+ *
+ * Count rows, weight rows and rating rows are padded to a multiple of SCORE_LANES, so
+ * kernels work on whole vectors without a remainder loop. The fastest
+ * kernel the cpu supports is picked at runtime.
+ */
+
+const unsigned SCORE_LANES {4}; /// Doubles per 256 bit vector, the AVX2 kernels take 4 counts at a time
+
+/// Language slots per row, nlang rounded up to SCORE_LANES
+inline unsigned padded_width(const unsigned nlang) {
+    return (nlang + SCORE_LANES - 1) / SCORE_LANES * SCORE_LANES;
+}
+
+/// Adds counts[k] * factor to ratings[k] for all k < width (multiple of SCORE_LANES)
+typedef void (*ScoreKernel)(double* ratings, const unsigned* counts, const unsigned width, const double factor);
+
+/// Same for 16 bit counts of pattern stores not promoted yet
+typedef void (*NarrowKernel)(double* ratings, const uint16_t* counts, const unsigned width, const double factor);
+
+/// Adds weights[k] * factor to ratings[k] for all k < width (multiple of SCORE_LANES)
+typedef void (*WeightKernel)(double* ratings, const float* weights, const unsigned width, const double factor);
+
+/// Returns the AVX2, SSE2 or scalar kernel, whichever the cpu supports best
+ScoreKernel select_score_kernel();
+NarrowKernel select_narrow_kernel();
+WeightKernel select_weight_kernel();
+/// Name of the kernel returned by select_score_kernel
+const char* score_kernel_name();
+
+#endif // SCORING_H_INCLUDED
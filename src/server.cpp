@@ -0,0 +1,292 @@
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "server.h"
+
+using namespace std;
+
+const size_t Server::WINDOW;
+const size_t Server::MAX_LINE;
+
+Server::Server(const Brain& brain, const string& socket_path)
+: brain(brain), socket_path {socket_path}, started {Clock::now()}
+{
+    latencies.reserve(WINDOW);
+}
+
+/**
+ * @brief Binds the socket and serves clients until "!shutdown"
+ *
+ * A stale socket file at the path gets replaced unless a server still
+ * listens on it, the socket is removed again once the server stops.
+ *
+ * @return False if the socket can't be set up
+ *
+ */
+bool Server::run() {
+    sockaddr_un address {};
+    address.sun_family = AF_UNIX;
+    if(socket_path.size() >= sizeof(address.sun_path)) {
+        cerr << "ERROR: Socket path " << socket_path << " is too long!\n";
+        return false;
+    }
+    strcpy(address.sun_path, socket_path.c_str());
+    // Only a stale socket of an earlier run is replaced, never another file
+    // and never the socket of a server that still accepts connections
+    struct stat existing;
+    if(lstat(socket_path.c_str(), &existing) == 0) {
+        if(!S_ISSOCK(existing.st_mode)) {
+            cerr << "ERROR: " << socket_path << " exists and is not a socket!\n";
+            return false;
+        }
+        const int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        const bool live = probe >= 0 && connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+        const int error = errno;
+        if(probe >= 0) close(probe);
+        if(live) {
+            cerr << "ERROR: " << socket_path << " is in use by a running server!\n";
+            return false;
+        }
+        if(error != ECONNREFUSED) {
+            cerr << "ERROR: Can't check " << socket_path << ": " << strerror(error) << "\n";
+            return false;
+        }
+        unlink(socket_path.c_str());
+    }
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listen_fd < 0 || bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+       || listen(listen_fd, 64) != 0) {
+        cerr << "ERROR: Can't listen on " << socket_path << ": " << strerror(errno) << "\n";
+        if(listen_fd >= 0) close(listen_fd);
+        return false;
+    }
+    cerr << "Serving on " << socket_path << "\n";
+    started = Clock::now();
+
+    thread dispatcher(&Server::dispatch, this);
+    while(!stopping) {
+        const int fd = accept(listen_fd, nullptr, nullptr);
+        if(fd < 0) {
+            if(errno == EINTR) continue;
+            break;
+        }
+        lock_guard<mutex> lock(clients_mutex);
+        if(stopping) {
+            close(fd);
+            break;
+        }
+        clients.insert(fd);
+        thread(&Server::serve_client, this, fd).detach();
+    }
+    stop();
+    {
+        unique_lock<mutex> lock(clients_mutex);
+        left.wait(lock, [this] { return clients.empty(); });
+    }
+    dispatcher.join();
+    close(listen_fd);
+    unlink(socket_path.c_str());
+    return true;
+}
+
+/**
+ * @brief Stops accepting and wakes up all blocked threads
+ */
+void Server::stop() {
+    stopping = true;
+    shutdown(listen_fd, SHUT_RDWR);
+    {
+        lock_guard<mutex> lock(clients_mutex);
+        for(int fd : clients) shutdown(fd, SHUT_RD);
+    }
+    lock_guard<mutex> lock(queue_mutex);
+    queued.notify_all();
+}
+
+/**
+ * @brief Reads lines of a client and answers them in order
+ *
+ * All complete lines of one read form a request, commands are answered
+ * after the lines before them. Lines with broken UTF-8 get "-" like lines
+ * without a valid word, so do lines longer than MAX_LINE bytes, which are
+ * dropped while they arrive.
+ *
+ * @param fd Socket of the client
+ *
+ */
+void Server::serve_client(const int fd) {
+    set<wchar_t> unknown;
+    string pending;
+    char buffer[65'536];
+    bool open {true};
+    bool overlong {false}; // Dropping the rest of a line beyond MAX_LINE
+    while(open) {
+        const ssize_t got = read(fd, buffer, sizeof(buffer));
+        if(got < 0 && errno == EINTR) continue;
+        if(got <= 0) break;
+        pending.append(buffer, got);
+        Request request;
+        size_t begin {0};
+        for(size_t end = pending.find('\n'); end != string::npos && open; end = pending.find('\n', begin)) {
+            if(overlong) {
+                overlong = false;
+                begin = end + 1;
+                request.line_ends.push_back(request.words.size());
+                continue;
+            }
+            const string line = pending.substr(begin, end - begin);
+            begin = end + 1;
+            if(!line.empty() && line[0] == '!') {
+                classify(request);
+                open = send_all(fd, request.results) && command(line, fd);
+                request = Request();
+                continue;
+            }
+            brain.convert_line(line, request.words, unknown);
+            request.line_ends.push_back(request.words.size());
+        }
+        if(overlong || pending.size() - begin > MAX_LINE) {
+            overlong = true;
+            begin = pending.size();
+        }
+        pending.erase(0, begin);
+        classify(request);
+        if(open) open = send_all(fd, request.results);
+    }
+    lock_guard<mutex> lock(clients_mutex);
+    clients.erase(fd);
+    close(fd);
+    left.notify_all();
+}
+
+/**
+ * @brief Queues a request and waits until the dispatcher classified it
+ */
+void Server::classify(Request& request) {
+    if(request.line_ends.empty()) return;
+    request.received = Clock::now();
+    unique_lock<mutex> lock(queue_mutex);
+    if(stopping) return;
+    queue.push_back(&request);
+    queued.notify_one();
+    finished.wait(lock, [&request] { return request.done; });
+}
+
+/**
+ * @brief Classifies waiting requests in batches until the server stops
+ *
+ * Takes all waiting requests, at least one and at most Brain.batch_size
+ * words, so the batch size follows the load.
+ *
+ */
+void Server::dispatch() {
+    vector<Request*> taken;
+    vector<Brainword> words;
+    for(;;) {
+        {
+            unique_lock<mutex> lock(queue_mutex);
+            queued.wait(lock, [this] { return !queue.empty() || stopping; });
+            if(queue.empty()) break;
+            size_t count {0};
+            while(!queue.empty() && (taken.empty() || count + queue.front()->words.size() <= brain.batch_size)) {
+                count += queue.front()->words.size();
+                taken.push_back(queue.front());
+                queue.pop_front();
+            }
+        }
+        for(const Request* request : taken) words.insert(words.end(), request->words.begin(), request->words.end());
+        const vector<Classification> classes = brain.classify_batch(words);
+
+        const Clock::time_point now = Clock::now();
+        size_t first {0};
+        {
+            lock_guard<mutex> lock(latency_mutex);
+            batches++;
+            batch_words += words.size();
+            for(Request* request : taken) {
+                const uint64_t ns = chrono::duration_cast<chrono::nanoseconds>(now - request->received).count();
+                for(size_t l = 0; l < request->line_ends.size(); l++, lines++) {
+                    if(latencies.size() < WINDOW) latencies.push_back(ns);
+                    else latencies[lines % WINDOW] = ns;
+                    brain.stats.record(Stats::SERVE_REQUEST, ns);
+                }
+            }
+        }
+        lock_guard<mutex> lock(queue_mutex);
+        for(Request* request : taken) {
+            const vector<Classification> own(classes.begin() + first, classes.begin() + first + request->words.size());
+            brain.format_lines(own, request->line_ends, request->results);
+            first += request->words.size();
+            request->done = true;
+        }
+        finished.notify_all();
+        taken.clear();
+        words.clear();
+    }
+    lock_guard<mutex> lock(queue_mutex);
+    for(Request* request : queue) request->done = true;
+    queue.clear();
+    finished.notify_all();
+}
+
+/**
+ * @brief Answers "!stats" and "!shutdown", unknown commands get an error line
+ * @return False if the connection should be closed
+ *
+ */
+bool Server::command(const string& line, const int fd) {
+    string name = line;
+    if(!name.empty() && name.back() == '\r') name.pop_back();
+    if(name == "!stats") return send_all(fd, stats_json() + "\n");
+    if(name == "!shutdown") {
+        send_all(fd, "bye\n");
+        stop();
+        return false;
+    }
+    return send_all(fd, "! unknown command " + name + "\n");
+}
+
+/**
+ * @brief Writes all of data, false if the client is gone
+ */
+bool Server::send_all(const int fd, const string& data) {
+    for(size_t sent = 0; sent < data.size();) {
+        const ssize_t put = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if(put < 0 && errno == EINTR) continue;
+        if(put <= 0) return false;
+        sent += put;
+    }
+    return true;
+}
+
+/**
+ * @brief Formats served lines, rates and latency percentiles as JSON
+ *
+ * Percentiles are taken over the latest Server.WINDOW lines. A line's
+ * latency reaches from its arrival to its classification, waiting for a
+ * batch included.
+ *
+ */
+string Server::stats_json() const {
+    lock_guard<mutex> lock(latency_mutex);
+    vector<uint64_t> sorted(latencies);
+    sort(sorted.begin(), sorted.end());
+    const auto percentile = [&sorted](const double p) -> uint64_t {
+        return sorted.empty() ? 0 : sorted[min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))];
+    };
+    const double seconds = chrono::duration<double>(Clock::now() - started).count();
+    ostringstream out;
+    out << "{\"lines\": " << lines << ", \"seconds\": " << seconds << ", \"qps\": " << lines / seconds
+        << ", \"batches\": " << batches << ", \"mean_batch_words\": " << (batches == 0 ? 0 : batch_words / static_cast<double>(batches))
+        << ", \"p50_ns\": " << percentile(0.5) << ", \"p99_ns\": " << percentile(0.99) << "}";
+    return out.str();
+}
@@ -0,0 +1,85 @@
+#ifndef SERVER_H_INCLUDED
+#define SERVER_H_INCLUDED
+#include <vector>
+#include <string>
+#include <deque>
+#include <set>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "wordbooks.h"
+
+using std::vector;
+using std::string;
+
+/**
+ * @brief Classification daemon on a Unix domain socket
+ *
+ * Clients send lines of text and get one "label<TAB>rates" line back per
+ * line, like Brain::classify_stream. "!stats" answers with latency
+ * percentiles and throughput as JSON, "!shutdown" stops the server.
+ *
+ * Every client gets a thread which hands all complete lines of a read as
+ * one request to the dispatcher. The dispatcher takes all waiting requests
+ * up to Brain.batch_size words and classifies them in one
+ * Brain::classify_batch on Brain.threads workers. A lone request is
+ * answered right away, under load batches grow by themselves.
+ *
+ */
+class Server {
+public:
+    Server(const Brain& brain, const string& socket_path);
+
+    /// Serves until a client sends "!shutdown", false if the socket can't be set up
+    bool run();
+    /// Requests, rates, batch sizes and latency percentiles as JSON object
+    string stats_json() const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    /// Lines of one read of a client
+    struct Request {
+        vector<vector<unsigned char>> words;
+        vector<size_t> line_ends; /// End of the words of each line
+        string results;
+        bool done {false};
+        Clock::time_point received;
+    };
+
+    void serve_client(const int fd);
+    void dispatch();
+    /// Hands a request to the dispatcher and waits for its results
+    void classify(Request& request);
+    /// Answers a "!" command, true if the client connection stays open
+    bool command(const string& line, const int fd);
+    void stop();
+    static bool send_all(const int fd, const string& data);
+
+    const Brain& brain;
+    const string socket_path;
+    int listen_fd {-1};
+    std::atomic<bool> stopping {false};
+
+    std::mutex queue_mutex; /// Guards queue, Request.done and Request.results
+    std::condition_variable queued;
+    std::condition_variable finished;
+    std::deque<Request*> queue;
+
+    mutable std::mutex clients_mutex;
+    std::condition_variable left; /// Notified whenever a client thread ends
+    std::set<int> clients; /// Open client sockets, shut down on stop
+
+    static const size_t MAX_LINE {1 << 20}; /// Longest line in bytes, longer ones get "-"
+    static const size_t WINDOW {65'536}; /// Latencies kept for percentiles
+    mutable std::mutex latency_mutex; /// Guards all counters below
+    vector<uint64_t> latencies; /// Ring of the latest line latencies in ns
+    uint64_t lines {0};
+    uint64_t batches {0};
+    uint64_t batch_words {0};
+    Clock::time_point started;
+};
+
+#endif // SERVER_H_INCLUDED
@@ -0,0 +1,176 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <memory>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "snapshot.h"
+
+using namespace std;
+
+/**
+ * @brief Maps the whole file read only, stays closed on failure
+ * @param file Path of the file
+ *
+ */
+MappedFile::MappedFile(const string& file) {
+    const int fd = open(file.c_str(), O_RDONLY);
+    if(fd < 0) return;
+    struct stat info;
+    if(fstat(fd, &info) == 0 && info.st_size > 0) {
+        void* at = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if(at != MAP_FAILED) {
+            bytes = static_cast<const char*>(at);
+            length = info.st_size;
+        }
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if(bytes) munmap(const_cast<char*>(bytes), length);
+}
+
+/**
+ * @brief Drops the resident pages of a range from memory
+ *
+ * Only pages lying completely inside the range are dropped, the mapping
+ * stays valid.
+ *
+ * @param from Start of the range inside the mapping
+ * @param count Length of the range in bytes
+ *
+ */
+void MappedFile::release(const void* from, const size_t count) const {
+    const uintptr_t page = sysconf(_SC_PAGESIZE);
+    const uintptr_t begin = (reinterpret_cast<uintptr_t>(from) + page - 1) / page * page;
+    const uintptr_t end = (reinterpret_cast<uintptr_t>(from) + count) / page * page;
+    if(end > begin) madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED);
+}
+
+SnapshotWriter::SnapshotWriter(const string& file)
+: target {file}, temp {file + ".tmp"}, out(temp, ios::binary | ios::trunc)
+{
+}
+
+SnapshotWriter::~SnapshotWriter() {
+    if(committed) return;
+    out.close();
+    unlink(temp.c_str());
+}
+
+/**
+ * @brief Flushes and syncs the temporary file, then renames it over the target
+ *
+ * The target is only replaced by a complete file, a failed commit leaves
+ * it untouched and removes the temporary file.
+ *
+ * @return False if writing, syncing or renaming failed
+ *
+ */
+bool SnapshotWriter::commit() {
+    committed = true;
+    out.flush();
+    bool ok = good();
+    out.close();
+    if(ok) {
+        const int fd = open(temp.c_str(), O_RDONLY);
+        ok = fd >= 0 && fsync(fd) == 0;
+        if(fd >= 0) close(fd);
+    }
+    ok = ok && rename(temp.c_str(), target.c_str()) == 0;
+    if(!ok) unlink(temp.c_str());
+    return ok;
+}
+
+void SnapshotWriter::put_string(const string& text) {
+    put<uint32_t>(text.size());
+    write(text.data(), text.size());
+}
+
+void SnapshotWriter::write(const void* data, const size_t bytes) {
+    out.write(static_cast<const char*>(data), bytes);
+    offset += bytes;
+}
+
+/**
+ * @brief Pads with zeroes up to the next multiple of SNAPSHOT_ALIGN
+ */
+void SnapshotWriter::align() {
+    static const char padding[SNAPSHOT_ALIGN] {};
+    write(padding, (SNAPSHOT_ALIGN - offset % SNAPSHOT_ALIGN) % SNAPSHOT_ALIGN);
+}
+
+SnapshotReader::SnapshotReader(const string& file)
+: file(make_shared<const MappedFile>(file)), ok{this->file->is_open()}
+{
+}
+
+string SnapshotReader::get_string() {
+    const uint32_t len = get<uint32_t>();
+    const char* at = take(len);
+    return at ? string(at, len) : string();
+}
+
+/**
+ * @brief Hands out the next bytes of the mapping
+ * @param bytes Amount of bytes
+ * @return Start of the bytes or nullptr if the file is too short
+ *
+ */
+const char* SnapshotReader::take(const size_t bytes) {
+    if(!ok || bytes > file->size() - offset) return fail<char>();
+    const char* at = file->data() + offset;
+    offset += bytes;
+    return at;
+}
+
+void SnapshotReader::align() {
+    offset += (SNAPSHOT_ALIGN - offset % SNAPSHOT_ALIGN) % SNAPSHOT_ALIGN;
+    if(offset > file->size()) fail<char>();
+}
+
+void ModelHeader::write(SnapshotWriter& writer) const {
+    writer.put(SNAPSHOT_MAGIC);
+    writer.put(SNAPSHOT_VERSION);
+    writer.put<uint32_t>(minlength);
+    writer.put<uint32_t>(maxlength);
+    writer.put<uint32_t>(maxlength2);
+    writer.put<uint32_t>(max_pattern_len);
+    writer.put<uint32_t>(langlist.size());
+    for(const string& lang : langlist) writer.put_string(lang);
+}
+
+/**
+ * @brief Reads the settings of a model snapshot
+ *
+ * Quits if the file can't be mapped, isn't a model or has another version.
+ *
+ */
+ModelHeader ModelHeader::read(SnapshotReader& reader) {
+    ModelHeader header;
+    if(reader.get<uint64_t>() != SNAPSHOT_MAGIC) {
+        cerr << "ERROR: Model file can't be opened or is no model!\n";
+        exit(-1);
+    }
+    const uint32_t version = reader.get<uint32_t>();
+    if(version != SNAPSHOT_VERSION) {
+        cerr << "ERROR: Model file has version " << version << ", expected " << SNAPSHOT_VERSION << "!\n";
+        exit(-1);
+    }
+    header.minlength = reader.get<uint32_t>();
+    header.maxlength = reader.get<uint32_t>();
+    header.maxlength2 = reader.get<uint32_t>();
+    header.max_pattern_len = reader.get<uint32_t>();
+    const uint32_t nlang = reader.get<uint32_t>();
+    for(uint32_t i = 0; i < nlang && reader.good(); i++) header.langlist.push_back(reader.get_string());
+    if(!reader.good()) {
+        cerr << "ERROR: Model file is truncated!\n";
+        exit(-1);
+    }
+    return header;
+}
@@ -0,0 +1,144 @@
+#ifndef SNAPSHOT_H_INCLUDED
+#define SNAPSHOT_H_INCLUDED
+#include <vector>
+#include <string>
+#include <fstream>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+using std::vector;
+using std::string;
+
+/**
+ * @brief Read only memory mapping of a whole file
+ *
+ * Pages are mapped shared, so processes mapping the same model file share
+ * their physical memory.
+ *
+ */
+class MappedFile {
+public:
+    explicit MappedFile(const string& file);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool is_open() const { return bytes != nullptr; }
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+    /// Drops the resident pages of a range, they are read from the file again on access
+    void release(const void* from, const size_t count) const;
+
+private:
+    const char* bytes {nullptr};
+    size_t length {0};
+};
+
+/**
+ * @brief Sequential writer of snapshot files
+ *
+ * Values are written in native byte order. Arrays start at multiples of
+ * SNAPSHOT_ALIGN, so they can be used straight from a mapping.
+ *
+ * Everything goes to "file.tmp" first, SnapshotWriter::commit syncs it
+ * and renames it over the file. A snapshot mapped meanwhile, even the one
+ * being replaced, stays intact. Without a commit the temporary file is
+ * removed.
+ *
+ */
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(const string& file);
+    ~SnapshotWriter();
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    bool good() const { return static_cast<bool>(out); }
+    /// Syncs the written file and moves it over the target, false if anything failed
+    bool commit();
+
+    template<typename T>
+    void put(const T& value) { write(&value, sizeof(T)); }
+    void put_string(const string& text);
+    template<typename T>
+    void put_array(const T* data, const size_t count) {
+        align();
+        write(data, count * sizeof(T));
+    }
+
+private:
+    void write(const void* data, const size_t bytes);
+    void align();
+
+    const string target; /// File replaced on commit
+    const string temp; /// File written to until the commit
+    std::ofstream out;
+    size_t offset {0};
+    bool committed {false};
+};
+
+/**
+ * @brief Sequential reader over a mapped snapshot file
+ *
+ * Arrays are handed out as pointers into the mapping. Reading past the end
+ * sets the reader to failed and returns zeroes or nullptr.
+ *
+ */
+class SnapshotReader {
+public:
+    explicit SnapshotReader(const string& file);
+
+    bool good() const { return ok; }
+    /// Mapping the arrays point into, keeps it alive while shared
+    const std::shared_ptr<const MappedFile>& mapping() const { return file; }
+
+    template<typename T>
+    T get() {
+        T value {};
+        const char* at = take(sizeof(T));
+        if(at) std::memcpy(&value, at, sizeof(T));
+        return value;
+    }
+    string get_string();
+    template<typename T>
+    const T* get_array(const size_t count) {
+        align();
+        if(count > file->size() / sizeof(T)) return fail<T>();
+        return reinterpret_cast<const T*>(take(count * sizeof(T)));
+    }
+
+private:
+    const char* take(const size_t bytes);
+    void align();
+    template<typename T>
+    const T* fail() {
+        ok = false;
+        return nullptr;
+    }
+
+    std::shared_ptr<const MappedFile> file;
+    size_t offset {0};
+    bool ok;
+};
+
+const uint64_t SNAPSHOT_MAGIC {0x4c45444f4d474c47}; /// "GLGMODEL"
+const uint64_t WORDBOOK_CACHE_MAGIC {0x5344524f57474c47}; /// "GLGWORDS"
+const uint32_t SNAPSHOT_VERSION {6}; /// Bumped on every format change
+const size_t SNAPSHOT_ALIGN {64}; /// Alignment of arrays in snapshot files
+
+/// Settings stored at the beginning of a model snapshot
+struct ModelHeader {
+    unsigned minlength {};
+    unsigned maxlength {};
+    unsigned maxlength2 {};
+    unsigned max_pattern_len {};
+    vector<string> langlist;
+
+    void write(SnapshotWriter& writer) const;
+    /// Reads and checks magic number, version and settings
+    static ModelHeader read(SnapshotReader& reader);
+};
+
+#endif // SNAPSHOT_H_INCLUDED
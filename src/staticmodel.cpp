@@ -0,0 +1,292 @@
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include "patternstore.h"
+#include "scoring.h"
+#include "wordbook.h"
+#include "staticmodel.h"
+
+using namespace std;
+
+const unsigned StaticModel::NONE;
+constexpr double StaticModel::ALPHA;
+constexpr double StaticModel::KEYS_PER_BUCKET;
+
+/**
+ * @brief Compiles the patterns of all stores into the table
+ *
+ * Keys of all nodes are derived from their parents, which always come
+ * first. Equal keys of different slices would share one record, the last
+ * one wins. Pilots are searched with a new seed until all buckets got one.
+ *
+ * @param stores Trained pattern stores, only read while building
+ * @param langs Count of languages
+ *
+ */
+void StaticModel::build(const vector<PatternStore>& stores, const unsigned langs) {
+    clear();
+    nlang = langs;
+    width = padded_width(nlang);
+    stride = width + 1;
+    record_len = stride + 1;
+
+    vector<uint64_t> keys;
+    vector<pair<unsigned, unsigned>> sources; // Position and node per key
+    for(unsigned j = 0; j < stores.size(); j++) {
+        const PatternStore& store = stores[j];
+        const vector<unsigned> parent = store.parents();
+        const vector<unsigned char> label = store.labels();
+        vector<uint64_t> node_key(parent.size());
+        node_key[PatternStore::NIL] = start(j);
+        for(unsigned node = 1; node < parent.size(); node++) {
+            node_key[node] = extend(node_key[parent[node]], label[node]);
+            keys.push_back(node_key[node]);
+            sources.emplace_back(j, node);
+        }
+    }
+
+    vector<uint64_t> unique_keys(keys);
+    sort(unique_keys.begin(), unique_keys.end());
+    unique_keys.erase(unique(unique_keys.begin(), unique_keys.end()), unique_keys.end());
+    patterns = unique_keys.size();
+    if(patterns != 0) {
+        table_size = max<size_t>(patterns / ALPHA, patterns + 1);
+        bucket_count = max<size_t>(patterns / KEYS_PER_BUCKET, 2);
+        dense_buckets = max<size_t>(bucket_count * 3 / 10, 1);
+        own_pilots.assign(bucket_count, 0);
+        for(seed = 0; !place(unique_keys); seed++) {}
+    }
+    own();
+
+    own_records.assign(patterns * record_len, 0);
+    for(size_t k = 0; k < keys.size(); k++) {
+        const PatternStore& store = stores[sources[k].first];
+        const unsigned node = sources[k].second;
+        uint16_t* record = &own_records[lookup(keys[k]) * record_len];
+        record[0] = fingerprint(keys[k]);
+        if(const unsigned* rates = store.wide_row(node)) {
+            const uint32_t index = own_wide.size() / stride;
+            own_wide.insert(own_wide.end(), rates, rates + stride);
+            record[1] = PatternStore::PROMOTED;
+            memcpy(record + 2, &index, sizeof(index));
+        }
+        else copy(store.narrow_row(node), store.narrow_row(node) + stride, record + 1);
+    }
+    wide_count = own_wide.size() / stride;
+    own();
+    built = true;
+}
+
+/**
+ * @brief Points the arrays to the owned vectors, called whenever they were resized
+ */
+void StaticModel::own() {
+    pilots = own_pilots.data();
+    remap = own_remap.data();
+    records = own_records.data();
+    wide = own_wide.data();
+}
+
+/**
+ * @brief Searches a pilot for every bucket, largest buckets first
+ *
+ * A pilot is taken if it moves all keys of its bucket to distinct free
+ * slots. Taken slots beyond the patterns get remapped onto the free
+ * indices below.
+ *
+ * @param keys Distinct keys
+ * @return False if no 16 bit pilot fits some bucket
+ *
+ */
+bool StaticModel::place(const vector<uint64_t>& keys) {
+    vector<pair<size_t, uint64_t>> by_bucket;
+    by_bucket.reserve(keys.size());
+    for(uint64_t key : keys) by_bucket.emplace_back(bucket(key), key);
+    sort(by_bucket.begin(), by_bucket.end());
+    vector<pair<size_t, size_t>> ranges; // Begin and end in by_bucket per non empty bucket
+    for(size_t begin = 0, end = 0; begin < by_bucket.size(); begin = end) {
+        while(end < by_bucket.size() && by_bucket[end].first == by_bucket[begin].first) end++;
+        ranges.emplace_back(begin, end);
+    }
+    stable_sort(ranges.begin(), ranges.end(), [](const pair<size_t, size_t>& a, const pair<size_t, size_t>& b) {
+        return a.second - a.first > b.second - b.first;
+    });
+
+    vector<bool> taken(table_size, false);
+    vector<size_t> slots;
+    for(const pair<size_t, size_t>& range : ranges) {
+        bool found {false};
+        for(unsigned pilot = 0; pilot <= 0xFFFF && !found; pilot++) {
+            slots.clear();
+            found = true;
+            for(size_t k = range.first; k < range.second && found; k++) {
+                const size_t s = slot(by_bucket[k].second, pilot);
+                found = !taken[s] && std::find(slots.begin(), slots.end(), s) == slots.end();
+                slots.push_back(s);
+            }
+            if(found) own_pilots[by_bucket[range.first].first] = pilot;
+        }
+        if(!found) return false;
+        for(size_t s : slots) taken[s] = true;
+    }
+
+    own_remap.assign(table_size - patterns, 0);
+    size_t free_index {0};
+    for(size_t s = patterns; s < table_size; s++) {
+        if(!taken[s]) continue;
+        while(taken[free_index]) free_index++;
+        own_remap[s - patterns] = free_index++;
+    }
+    return true;
+}
+
+/**
+ * @brief Drops the table, the model is unusable until built again
+ */
+void StaticModel::clear() {
+    built = false;
+    patterns = 0;
+    table_size = 0;
+    bucket_count = 0;
+    wide_count = 0;
+    vector<uint16_t>().swap(own_pilots);
+    vector<uint32_t>().swap(own_remap);
+    vector<uint16_t>().swap(own_records);
+    vector<unsigned>().swap(own_wide);
+    own();
+    mapping.reset();
+}
+
+/**
+ * @brief Writes settings and arrays of the table, arrays as raw native data
+ */
+void StaticModel::save(SnapshotWriter& writer) const {
+    writer.put<uint32_t>(stride);
+    writer.put<uint64_t>(patterns);
+    writer.put<uint64_t>(seed);
+    writer.put<uint64_t>(table_size);
+    writer.put<uint64_t>(bucket_count);
+    writer.put<uint64_t>(dense_buckets);
+    writer.put<uint64_t>(wide_count);
+    writer.put_array(pilots, bucket_count);
+    writer.put_array(remap, table_size - patterns);
+    writer.put_array(records, patterns * record_len);
+    writer.put_array(wide, wide_count * stride);
+}
+
+/**
+ * @brief Points the table to arrays inside a mapped snapshot
+ * @param reader Reader positioned at a table written by StaticModel::save
+ * @param langs Count of languages
+ * @return False if the snapshot is broken or doesn't fit the row stride
+ *
+ */
+bool StaticModel::map(SnapshotReader& reader, const unsigned langs) {
+    clear();
+    nlang = langs;
+    width = padded_width(nlang);
+    stride = width + 1;
+    record_len = stride + 1;
+    const uint32_t file_stride = reader.get<uint32_t>();
+    patterns = reader.get<uint64_t>();
+    seed = reader.get<uint64_t>();
+    table_size = reader.get<uint64_t>();
+    bucket_count = reader.get<uint64_t>();
+    dense_buckets = reader.get<uint64_t>();
+    wide_count = reader.get<uint64_t>();
+    if(!reader.good() || file_stride != stride || table_size < patterns
+       || (patterns != 0 && (dense_buckets == 0 || dense_buckets >= bucket_count))) {
+        clear();
+        return false;
+    }
+    pilots = reader.get_array<uint16_t>(bucket_count);
+    remap = reader.get_array<uint32_t>(table_size - patterns);
+    records = reader.get_array<uint16_t>(patterns * record_len);
+    wide = reader.get_array<unsigned>(wide_count * stride);
+    if(!reader.good()) {
+        clear();
+        return false;
+    }
+    mapping = reader.mapping();
+    built = true;
+    return true;
+}
+
+/**
+ * @brief Returns the wide count row of a promoted record, nullptr otherwise
+ */
+const unsigned* StaticModel::wide_row(const unsigned record) const {
+    const uint16_t* row = narrow_row(record);
+    if(row[0] != PatternStore::PROMOTED) return nullptr;
+    uint32_t index;
+    memcpy(&index, row + 1, sizeof(index));
+    return &wide[static_cast<size_t>(index) * stride];
+}
+
+/**
+ * @brief Looks up a slice at a position
+ * @param pos Position of the slice
+ * @param slice First char of the slice
+ * @param len Length of the slice
+ * @return Record of the slice or NONE
+ *
+ */
+unsigned StaticModel::find(const unsigned pos, const unsigned char* slice, const size_t len) const {
+    if(len == 0) return NONE;
+    uint64_t key = start(pos);
+    for(size_t i = 0; i < len; i++) key = extend(key, slice[i]);
+    return record_of(key);
+}
+
+/**
+ * @brief Sums up ratings of a word per pattern length
+ *
+ * Same sums as Brain::rate_patterns on the stores the table was built
+ * from, the key of every slice extends the key of the slice before.
+ *
+ * @param word Word to rate
+ * @param plen Amount of pattern lengths
+ * @param def_rating Rating per language of unknown patterns
+ * @param rating_per_pattern Receives one row per pattern length, padded like count rows
+ * @return Amount of patterns found
+ *
+ */
+unsigned StaticModel::rate(const Brainword& word, const unsigned plen, const double def_rating,
+                           vector<double>& rating_per_pattern) const {
+    rating_per_pattern.assign(plen * width, 0);
+    unsigned hits {0};
+    for(unsigned j = 0; j < word.size(); j++) {
+        const unsigned reach = min<size_t>(plen, word.size() - j);
+        uint64_t key = start(j);
+        for(unsigned i = 1; i <= reach; i++) {
+            double* rates_i = &rating_per_pattern[(i - 1) * width];
+            key = extend(key, word[j + i - 1]);
+            const unsigned record = record_of(key);
+            if(record == NONE) {
+                // Slices are stored prefix closed, so all longer slices miss as well
+                for(; i <= reach; i++) {
+                    rates_i = &rating_per_pattern[(i - 1) * width];
+                    for(unsigned k = 0; k < nlang; k++) rates_i[k] += def_rating;
+                }
+                break;
+            }
+            const uint16_t* narrow = narrow_row(record);
+            if(narrow[0] != PatternStore::PROMOTED) narrow_kernel(rates_i, narrow + 1, width, 1.0 / narrow[0]);
+            else {
+                const unsigned* rates = wide_row(record);
+                score_kernel(rates_i, rates + 1, width, 1.0 / rates[0]);
+            }
+            hits++;
+        }
+    }
+    return hits;
+}
+
+/**
+ * @brief Returns bytes of pilots, remapped slots, records and wide rows, mapped or not
+ */
+size_t StaticModel::memory_usage() const {
+    return bucket_count * sizeof(uint16_t) + (table_size - patterns) * sizeof(uint32_t)
+        + patterns * record_len * sizeof(uint16_t) + wide_count * stride * sizeof(unsigned);
+}
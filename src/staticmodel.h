@@ -0,0 +1,137 @@
+#ifndef STATICMODEL_H_INCLUDED
+#define STATICMODEL_H_INCLUDED
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include "patternstore.h"
+#include "snapshot.h"
+#include "scoring.h"
+#include "wordbook.h"
+
+using std::vector;
+
+/**
+ * @brief Read only table of all trained patterns behind a minimal perfect hash
+ *
+ * Every slice is hashed together with its position into a 64 bit key,
+ * extended char by char, so longer slices of a position cost one step each.
+ * The keys are mapped onto 0 ... patterns - 1 by a PTHash style function:
+ * keys are spread over buckets, every bucket has a 16 bit pilot chosen so
+ * that its keys land on free slots of a table slightly larger than the
+ * amount of patterns. The few slots beyond are remapped to the free ones
+ * below. A lookup reads one pilot and one record, both for stored and for
+ * unknown slices.
+ *
+ * A record is a 16 bit fingerprint of the key followed by the narrow count
+ * row of the pattern, laid out like the rows of PatternStore. Keys of
+ * unknown slices are rejected by the fingerprint, one of 65536 passes and
+ * gets the counts of another slice.
+ *
+ * The table copies the counts, so it stays valid when the stores are
+ * dropped, but it has to be compiled again after training. Like a
+ * PatternStore it can be saved to a snapshot and served from the mapping.
+ *
+ */
+class StaticModel {
+public:
+    static const unsigned NONE = 0xFFFFFFFF; /// Lookup failure
+
+    /// Compiles all patterns of the stores
+    void build(const vector<PatternStore>& stores, const unsigned langs);
+    /// Drops the table
+    void clear();
+    /// True if built or mapped and not cleared since
+    bool ready() const { return built; }
+
+    /// Appends the table to a snapshot
+    void save(SnapshotWriter& writer) const;
+    /// Serves the table from a mapped snapshot, false if it is broken
+    bool map(SnapshotReader& reader, const unsigned langs);
+
+    /// Sums up ratings of a word per pattern length like Brain::rate_patterns, returns the amount of hits
+    unsigned rate(const Brainword& word, const unsigned plen, const double def_rating,
+                  vector<double>& rating_per_pattern) const;
+    /// Record of a slice at a position, or NONE
+    unsigned find(const unsigned pos, const unsigned char* slice, const size_t len) const;
+    /// Entry k of the count row of a record, 0 is the sum
+    unsigned count(const unsigned record, const unsigned k) const {
+        const unsigned* rates = wide_row(record);
+        return rates ? rates[k] : narrow_row(record)[k];
+    }
+
+    /// Amount of patterns
+    size_t size() const { return patterns; }
+    /// Bytes of pilots, remapped slots, records and wide rows, mapped or not
+    size_t memory_usage() const;
+
+private:
+    static constexpr double ALPHA {0.99}; /// Patterns per table slot
+    static constexpr double KEYS_PER_BUCKET {4.0}; /// Average bucket size
+
+    /// splitmix64 finalizer
+    static uint64_t mix(uint64_t value) {
+        value += 0x9e3779b97f4a7c15ULL;
+        value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+        return value ^ (value >> 31);
+    }
+    /// Key of the empty slice at a position
+    static uint64_t start(const unsigned pos) { return mix(pos + 0x5851f42d4c957f2dULL); }
+    /// Key of a slice extended by one char
+    static uint64_t extend(const uint64_t key, const unsigned char ch) { return mix(key ^ (ch + 1ULL) << 56); }
+    static uint16_t fingerprint(const uint64_t key) { return key >> 48; }
+    /// Bucket of a key, 60% of the keys go to the first 30% of the buckets
+    size_t bucket(const uint64_t key) const {
+        const uint64_t hashed = mix(key ^ seed);
+        if((hashed & 0xFFFF) < 39'322) return ((hashed >> 32) * dense_buckets) >> 32;
+        return dense_buckets + (((hashed >> 32) * (bucket_count - dense_buckets)) >> 32);
+    }
+    /// Slot of a key displaced by a pilot
+    size_t slot(const uint64_t key, const unsigned pilot) const {
+        return ((mix(key ^ seed ^ (pilot + 1ULL) * 0xc2b2ae3d27d4eb4fULL) >> 32) * table_size) >> 32;
+    }
+    /// Index of a key, stored keys get their own
+    size_t lookup(const uint64_t key) const {
+        const size_t index = slot(key, pilots[bucket(key)]);
+        return index < patterns ? index : remap[index - patterns];
+    }
+    /// Finds pilots for all keys, false if a bucket has none
+    bool place(const vector<uint64_t>& keys);
+    /// Points the arrays to the owned vectors
+    void own();
+    /// Record of a key, NONE on a miss
+    unsigned record_of(const uint64_t key) const {
+        if(patterns == 0) return NONE;
+        const size_t index = lookup(key);
+        if(records[index * record_len] != fingerprint(key)) return NONE;
+        return index;
+    }
+    const uint16_t* narrow_row(const unsigned record) const { return &records[static_cast<size_t>(record) * record_len + 1]; }
+    const unsigned* wide_row(const unsigned record) const;
+
+    bool built {false};
+    unsigned nlang {};
+    unsigned width {}; /// Padded amount of languages
+    unsigned stride {}; /// Length of a count row (width + 1)
+    unsigned record_len {}; /// Length of a record (stride + 1)
+    size_t patterns {0};
+    uint64_t seed {0}; /// Salt of bucket and slot hashes, raised until all buckets find a pilot
+    size_t table_size {0}; /// Slots, patterns / ALPHA
+    size_t dense_buckets {0}; /// Buckets getting 60% of the keys
+    size_t bucket_count {0};
+    size_t wide_count {0}; /// Amount of promoted rows
+    const uint16_t* pilots {nullptr}; /// Pilot per bucket
+    const uint32_t* remap {nullptr}; /// Free index per slot beyond the patterns
+    const uint16_t* records {nullptr}; /// Fingerprint and narrow count row per pattern
+    const unsigned* wide {nullptr}; /// Count rows of promoted patterns
+    vector<uint16_t> own_pilots; /// Storage of pilots unless mapped
+    vector<uint32_t> own_remap; /// Storage of remap unless mapped
+    vector<uint16_t> own_records; /// Storage of records unless mapped
+    vector<unsigned> own_wide; /// Storage of wide rows unless mapped
+    std::shared_ptr<const MappedFile> mapping; /// Snapshot the arrays point into
+    NarrowKernel narrow_kernel {select_narrow_kernel()};
+    ScoreKernel score_kernel {select_score_kernel()};
+};
+
+#endif // STATICMODEL_H_INCLUDED
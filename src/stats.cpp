@@ -0,0 +1,95 @@
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <sstream>
+#include <thread>
+#include <functional>
+#include <cstdint>
+#include "stats.h"
+
+using namespace std;
+
+const bool Stats::enabled;
+
+/**
+ * @brief Starts with all counters and histograms at zero
+ */
+Stats::Stats() {
+    reset();
+}
+
+/**
+ * @brief Returns the shard of the calling thread, picked once per thread
+ */
+unsigned Stats::shard() {
+    static thread_local const unsigned index = hash<thread::id>()(this_thread::get_id()) % SHARDS;
+    return index;
+}
+
+/**
+ * @brief Counts a latency in its power of two bucket
+ * @param histogram Histogram to count in
+ * @param ns Latency in nanoseconds
+ *
+ */
+void Stats::record(const Histogram histogram, const uint64_t ns) {
+    if(!enabled) return;
+    unsigned bucket {0};
+    while(bucket + 1 < BUCKETS && (ns >> bucket) != 0) bucket++;
+    buckets[histogram][bucket].fetch_add(1, memory_order_relaxed);
+}
+
+/**
+ * @brief Sums a counter over all shards
+ */
+uint64_t Stats::total(const Counter counter) const {
+    uint64_t sum {0};
+    for(const Shard& shard : shards) sum += shard.values[counter].load(memory_order_relaxed);
+    return sum;
+}
+
+void Stats::reset() {
+    for(Shard& shard : shards) {
+        for(atomic<uint64_t>& value : shard.values) value.store(0, memory_order_relaxed);
+    }
+    for(auto& histogram : buckets) {
+        for(atomic<uint64_t>& bucket : histogram) bucket.store(0, memory_order_relaxed);
+    }
+    since = chrono::steady_clock::now();
+}
+
+/**
+ * @brief Formats counters, derived rates and histograms as JSON object
+ *
+ * Rates per second refer to the time spent in training or classifying.
+ * Only words of Brain::classify_batch count as tested, as only there the
+ * time is taken.
+ * Histograms list the non-empty buckets as upper bound in ns and count.
+ *
+ */
+string Stats::json() const {
+    static const char* counter_names[COUNTERS] {"words_trained", "words_tested", "lookup_hits", "lookup_misses",
+                                                "shrinks", "words_merged", "train_ns", "test_ns"};
+    static const char* histogram_names[HISTOGRAMS] {"train_batch_ns", "classify_batch_ns", "serve_request_ns"};
+    ostringstream out;
+    out << "{\"enabled\": " << (enabled ? "true" : "false");
+    out << ", \"seconds\": " << chrono::duration<double>(chrono::steady_clock::now() - since).count();
+    for(unsigned c = 0; c < COUNTERS; c++) out << ", \"" << counter_names[c] << "\": " << total(static_cast<Counter>(c));
+    const uint64_t lookups = total(LOOKUP_HITS) + total(LOOKUP_MISSES);
+    out << ", \"hit_ratio\": " << (lookups == 0 ? 0 : static_cast<double>(total(LOOKUP_HITS)) / lookups);
+    out << ", \"trained_per_second\": " << (total(TRAIN_NS) == 0 ? 0 : total(WORDS_TRAINED) * 1e9 / total(TRAIN_NS));
+    out << ", \"tested_per_second\": " << (total(TEST_NS) == 0 ? 0 : total(WORDS_TESTED) * 1e9 / total(TEST_NS));
+    for(unsigned h = 0; h < HISTOGRAMS; h++) {
+        out << ", \"" << histogram_names[h] << "\": [";
+        bool first {true};
+        for(unsigned b = 0; b < BUCKETS; b++) {
+            const uint64_t count = buckets[h][b].load(memory_order_relaxed);
+            if(count == 0) continue;
+            out << (first ? "" : ", ") << "[" << (uint64_t {1} << b) << ", " << count << "]";
+            first = false;
+        }
+        out << "]";
+    }
+    out << "}";
+    return out.str();
+}
@@ -0,0 +1,85 @@
+#ifndef STATS_H_INCLUDED
+#define STATS_H_INCLUDED
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @brief Counters and latency histograms of the hot paths
+ *
+ * Counters are split into shards on separate cache lines, every thread
+ * adds to its own shard with relaxed atomics. Histograms count latencies
+ * in power of two buckets of nanoseconds.
+ *
+ * Without GET_LANG_STATS counting and timing is inlined away, timers don't
+ * even read the clock. The shards and buckets are still allocated and
+ * stay zero.
+ *
+ */
+class Stats {
+public:
+    enum Counter { WORDS_TRAINED, WORDS_TESTED, LOOKUP_HITS, LOOKUP_MISSES, SHRINKS, WORDS_MERGED, TRAIN_NS, TEST_NS,
+                   COUNTERS };
+    enum Histogram { TRAIN_BATCH, CLASSIFY_BATCH, SERVE_REQUEST, HISTOGRAMS };
+
+#ifdef GET_LANG_STATS
+    static const bool enabled {true};
+#else
+    static const bool enabled {false};
+#endif
+
+    Stats();
+
+    void add(const Counter counter, const uint64_t amount = 1) {
+        if(enabled) shards[shard()].values[counter].fetch_add(amount, std::memory_order_relaxed);
+    }
+    void record(const Histogram histogram, const uint64_t ns);
+    uint64_t total(const Counter counter) const;
+    /// Clears all counters and histograms
+    void reset();
+    /// Counters, rates and histograms as JSON object
+    std::string json() const;
+
+    /// Records the lifetime of the timer into a histogram and a time counter
+    class Timer {
+    public:
+        /// Without histogram (HISTOGRAMS) only the counter is increased
+        Timer(Stats& stats, const Counter counter, const Histogram histogram = HISTOGRAMS)
+        : stats(stats), histogram {histogram}, counter {counter}
+        {
+            if(enabled) start = std::chrono::steady_clock::now();
+        }
+        ~Timer() {
+            if(!enabled) return;
+            const uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            if(histogram != HISTOGRAMS) stats.record(histogram, ns);
+            stats.add(counter, ns);
+        }
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+    private:
+        Stats& stats;
+        const Histogram histogram;
+        const Counter counter;
+        std::chrono::steady_clock::time_point start;
+    };
+
+private:
+    static const unsigned SHARDS {16};
+    static const unsigned BUCKETS {48}; /// Bucket b holds latencies below 2^b ns
+
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> values[COUNTERS];
+    };
+    /// Shard of the calling thread
+    static unsigned shard();
+
+    Shard shards[SHARDS];
+    std::atomic<uint64_t> buckets[HISTOGRAMS][BUCKETS];
+    std::chrono::steady_clock::time_point since; /// Start of counting
+};
+
+#endif // STATS_H_INCLUDED
@@ -0,0 +1,359 @@
+#include <vector>
+#include <string>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <cstdint>
+#include "snapshot.h"
+#include "transcoder.h"
+
+using namespace std;
+
+const uint32_t Transcoder::LOW_LIMIT;
+
+/**
+ * @brief Registers a char which gets converted to code
+ *
+ * Single bytes are matched directly, longer chars by their code point.
+ *
+ * @param ch The char as UTF-8
+ * @param code Code of the char in brainwords
+ *
+ */
+void Transcoder::add_char(const string& ch, const unsigned char code) {
+    uint32_t code_point {};
+    if(ch.size() == 1) charset1[ch[0]] = code;
+    else if(decode_utf8(ch.data(), ch.size(), code_point) != 0) charset2[code_point] = code;
+}
+
+/**
+ * @brief Registers a char which gets skipped
+ * @param ch The char as UTF-8
+ *
+ */
+void Transcoder::add_ignore(const string& ch) {
+    uint32_t code_point {};
+    if(ch.size() == 1) ignore1.insert(ch[0]);
+    else if(decode_utf8(ch.data(), ch.size(), code_point) != 0) ignore2.insert(code_point);
+}
+
+/**
+ * @brief Registers a char which gets replaced
+ * @param ch The char as UTF-8
+ * @param replacement Text which is converted instead of the char
+ *
+ */
+void Transcoder::add_conversion(const string& ch, const string& replacement) {
+    uint32_t code_point {};
+    if(decode_utf8(ch.data(), ch.size(), code_point) != 0) conversion[code_point] = replacement;
+}
+
+/**
+ * @brief Builds the lookup tables from the registered lists
+ *
+ * Single bytes take precedence over code points, as in the charset files.
+ * Conversions get converted in advance, conversions into unknown chars
+ * make the converted char unknown as well.
+ *
+ */
+void Transcoder::compile() {
+    expansions.clear();
+    low_table.assign(LOW_LIMIT, unknown);
+    high_table.clear();
+
+    set<uint32_t> code_points;
+    for(const auto& entry : charset2) code_points.insert(entry.first);
+    for(const auto& entry : conversion) code_points.insert(entry.first);
+    code_points.insert(ignore2.begin(), ignore2.end());
+    for(uint32_t code_point : code_points) {
+        const Entry entry = resolve(code_point, 0);
+        if(code_point < LOW_LIMIT) low_table[code_point] = entry;
+        else high_table.emplace_back(code_point, entry);
+    }
+
+    for(unsigned byte = 0; byte < 256; byte++) {
+        const char ch = static_cast<char>(byte);
+        Entry& entry = byte_table[byte];
+        if(charset1.find(ch) != charset1.end()) {
+            entry = Entry();
+            entry.action = CODE;
+            entry.code = charset1[ch];
+        }
+        else if(ignore1.find(ch) != ignore1.end()) {
+            entry = Entry();
+            entry.action = IGNORE;
+        }
+        else if(byte < 0x80) entry = low_table[byte];
+        else {
+            entry = Entry();
+            entry.action = DECODE;
+        }
+    }
+}
+
+/**
+ * @brief Determines the entry of a code point
+ * @param code_point The code point
+ * @param depth Nesting of conversions, stops cyclic conversions
+ * @return Entry of the code point
+ *
+ */
+Transcoder::Entry Transcoder::resolve(const uint32_t code_point, unsigned depth) {
+    Entry entry;
+    if(charset2.find(code_point) != charset2.end()) {
+        entry.action = CODE;
+        entry.code = charset2[code_point];
+    }
+    else if(ignore2.find(code_point) != ignore2.end()) {
+        entry.action = IGNORE;
+    }
+    else if(conversion.find(code_point) != conversion.end() && depth < 8) {
+        const string& replacement = conversion[code_point];
+        vector<unsigned char> codes;
+        for(size_t i = 0; i < replacement.size();) {
+            const char ch = replacement[i];
+            if(charset1.find(ch) != charset1.end()) {
+                codes.push_back(charset1[ch]);
+                i++;
+                continue;
+            }
+            if(ignore1.find(ch) != ignore1.end()) {
+                i++;
+                continue;
+            }
+            uint32_t inner {};
+            const unsigned step = decode_utf8(&replacement[i], replacement.size() - i, inner);
+            if(step == 0) return Entry();
+            const Entry part = resolve(inner, depth + 1);
+            if(part.action == CODE) codes.push_back(part.code);
+            else if(part.action == EXPAND) {
+                codes.insert(codes.end(), expansions.begin() + part.offset, expansions.begin() + part.offset + part.len);
+            }
+            else if(part.action != IGNORE) return Entry();
+            i += step;
+        }
+        entry.action = EXPAND;
+        entry.offset = expansions.size();
+        entry.len = codes.size();
+        expansions.insert(expansions.end(), codes.begin(), codes.end());
+    }
+    return entry;
+}
+
+/**
+ * @brief Returns the entry of a code point
+ */
+const Transcoder::Entry& Transcoder::lookup(const uint32_t code_point) const {
+    if(code_point < LOW_LIMIT) return low_table[code_point];
+    auto found = lower_bound(high_table.begin(), high_table.end(), code_point,
+                             [](const pair<uint32_t, Entry>& entry, uint32_t cp) { return entry.first < cp; });
+    if(found != high_table.end() && found->first == code_point) return found->second;
+    return unknown;
+}
+
+/**
+ * @brief Converts UTF-8 text to brainword codes
+ *
+ * @param text Text to convert
+ * @param len Length of text in bytes
+ * @param out Receives the codes, gets cleared first
+ * @param failed Unknown code point or position of an invalid byte
+ * @return OK, UNKNOWN on unregistered chars, INVALID on broken UTF-8
+ *
+ */
+Transcoder::Status Transcoder::transcode(const char* text, const size_t len, vector<unsigned char>& out, uint32_t& failed) const {
+    out.clear();
+    for(size_t i = 0; i < len;) {
+        uint32_t code_point = static_cast<unsigned char>(text[i]);
+        const Entry* entry = &byte_table[code_point];
+        unsigned step = 1;
+        if(entry->action == DECODE) {
+            step = decode_utf8(text + i, len - i, code_point);
+            if(step == 0) {
+                failed = i;
+                return INVALID;
+            }
+            entry = &lookup(code_point);
+        }
+        switch(entry->action) {
+        case CODE:
+            out.push_back(entry->code);
+            break;
+        case IGNORE:
+            break;
+        case EXPAND:
+            out.insert(out.end(), expansions.begin() + entry->offset, expansions.begin() + entry->offset + entry->len);
+            break;
+        default:
+            failed = code_point;
+            return UNKNOWN;
+        }
+        i += step;
+    }
+    return OK;
+}
+
+/**
+ * @brief Decodes the first code point of UTF-8 text
+ *
+ * Rejects stray continuation bytes, truncated sequences, overlong forms
+ * and surrogates.
+ *
+ * @param text UTF-8 text
+ * @param len Bytes available
+ * @param code_point Receives the code point
+ * @return Byte length of the code point or 0 if invalid
+ *
+ */
+unsigned Transcoder::decode_utf8(const char* text, const size_t len, uint32_t& code_point) {
+    if(len == 0) return 0;
+    const unsigned char lead = text[0];
+    unsigned size {};
+    uint32_t min {};
+    if(lead < 0x80) {
+        code_point = lead;
+        return 1;
+    }
+    else if((lead & 0xE0) == 0xC0) {
+        size = 2;
+        min = 0x80;
+        code_point = lead & 0x1F;
+    }
+    else if((lead & 0xF0) == 0xE0) {
+        size = 3;
+        min = 0x800;
+        code_point = lead & 0x0F;
+    }
+    else if((lead & 0xF8) == 0xF0) {
+        size = 4;
+        min = 0x10000;
+        code_point = lead & 0x07;
+    }
+    else return 0;
+    if(len < size) return 0;
+    for(unsigned i = 1; i < size; i++) {
+        const unsigned char cont = text[i];
+        if((cont & 0xC0) != 0x80) return 0;
+        code_point = (code_point << 6) | (cont & 0x3F);
+    }
+    if(code_point < min || code_point > 0x10FFFF || (code_point >= 0xD800 && code_point <= 0xDFFF)) return 0;
+    return size;
+}
+
+/**
+ * @brief Checks if all of text is valid UTF-8 as accepted by Transcoder::transcode
+ */
+bool Transcoder::valid_utf8(const char* text, const size_t len) {
+    uint32_t code_point;
+    for(size_t pos = 0; pos < len;) {
+        const unsigned step = decode_utf8(text + pos, len - pos, code_point);
+        if(step == 0) return false;
+        pos += step;
+    }
+    return true;
+}
+
+/**
+ * @brief Encodes a code point as UTF-8
+ */
+string Transcoder::encode_utf8(const uint32_t code_point) {
+    string text;
+    if(code_point < 0x80) text += static_cast<char>(code_point);
+    else if(code_point < 0x800) {
+        text += static_cast<char>(0xC0 | (code_point >> 6));
+        text += static_cast<char>(0x80 | (code_point & 0x3F));
+    }
+    else if(code_point < 0x10000) {
+        text += static_cast<char>(0xE0 | (code_point >> 12));
+        text += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+        text += static_cast<char>(0x80 | (code_point & 0x3F));
+    }
+    else {
+        text += static_cast<char>(0xF0 | (code_point >> 18));
+        text += static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+        text += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+        text += static_cast<char>(0x80 | (code_point & 0x3F));
+    }
+    return text;
+}
+
+/**
+ * @brief Writes charsets, conversion and ignore lists
+ */
+void Transcoder::save(SnapshotWriter& writer) const {
+    writer.put<uint32_t>(charset1.size());
+    for(const auto& entry : charset1) {
+        writer.put(entry.first);
+        writer.put(entry.second);
+    }
+    writer.put<uint32_t>(charset2.size());
+    for(const auto& entry : charset2) {
+        writer.put(entry.first);
+        writer.put(entry.second);
+    }
+    writer.put<uint32_t>(conversion.size());
+    for(const auto& entry : conversion) {
+        writer.put(entry.first);
+        writer.put_string(entry.second);
+    }
+    writer.put<uint32_t>(ignore1.size());
+    for(char ch : ignore1) writer.put(ch);
+    writer.put<uint32_t>(ignore2.size());
+    for(uint32_t code_point : ignore2) writer.put(code_point);
+}
+
+/**
+ * @brief Reads the lists written by Transcoder::save and compiles them
+ */
+void Transcoder::load(SnapshotReader& reader) {
+    charset1.clear();
+    charset2.clear();
+    conversion.clear();
+    ignore1.clear();
+    ignore2.clear();
+    const uint32_t charset1_size = reader.get<uint32_t>();
+    for(uint32_t i = 0; i < charset1_size && reader.good(); i++) {
+        const char ch = reader.get<char>();
+        charset1[ch] = reader.get<unsigned char>();
+    }
+    const uint32_t charset2_size = reader.get<uint32_t>();
+    for(uint32_t i = 0; i < charset2_size && reader.good(); i++) {
+        const uint32_t code_point = reader.get<uint32_t>();
+        charset2[code_point] = reader.get<unsigned char>();
+    }
+    const uint32_t conversion_size = reader.get<uint32_t>();
+    for(uint32_t i = 0; i < conversion_size && reader.good(); i++) {
+        const uint32_t code_point = reader.get<uint32_t>();
+        conversion[code_point] = reader.get_string();
+    }
+    const uint32_t ignore1_size = reader.get<uint32_t>();
+    for(uint32_t i = 0; i < ignore1_size && reader.good(); i++) ignore1.insert(reader.get<char>());
+    const uint32_t ignore2_size = reader.get<uint32_t>();
+    for(uint32_t i = 0; i < ignore2_size && reader.good(); i++) ignore2.insert(reader.get<uint32_t>());
+    compile();
+}
+
+/**
+ * @brief Hashes charsets, conversion and ignore lists (FNV-1a)
+ */
+uint64_t Transcoder::fingerprint() const {
+    uint64_t hash {0xcbf29ce484222325ULL};
+    const auto mix = [&hash](const string& bytes) {
+        for(char ch : bytes) {
+            hash ^= static_cast<unsigned char>(ch);
+            hash *= 0x100000001b3ULL;
+        }
+        hash ^= 0xFF; // separates the entries
+        hash *= 0x100000001b3ULL;
+    };
+    for(const auto& entry : charset1) mix(string(1, entry.first) + static_cast<char>(entry.second));
+    mix(string());
+    for(const auto& entry : charset2) mix(encode_utf8(entry.first) + static_cast<char>(entry.second));
+    mix(string());
+    for(const auto& entry : conversion) mix(encode_utf8(entry.first) + entry.second);
+    mix(string());
+    for(char ch : ignore1) mix(string(1, ch));
+    mix(string());
+    for(uint32_t code_point : ignore2) mix(encode_utf8(code_point));
+    return hash;
+}
@@ -0,0 +1,88 @@
+#ifndef TRANSCODER_H_INCLUDED
+#define TRANSCODER_H_INCLUDED
+#include <vector>
+#include <string>
+#include <map>
+#include <set>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+#include "snapshot.h"
+
+using std::vector;
+using std::string;
+using std::map;
+using std::set;
+
+/**
+ * @brief Compiled converter from UTF-8 text to brainword codes
+ *
+ * Charset, ignore and conversion lists are collected first and then
+ * compiled into a 256 entry table per lead byte plus a direct table for
+ * two byte code points. Longer code points are looked up in a small sorted
+ * table. Conversions are expanded to their codes in advance.
+ * Decoding keeps no state, so one transcoder can serve many threads.
+ *
+ */
+class Transcoder {
+public:
+    enum Status { OK, UNKNOWN, INVALID };
+
+    /// Registers a char (UTF-8) which gets converted to code
+    void add_char(const string& ch, const unsigned char code);
+    /// Registers a char (UTF-8) which gets skipped
+    void add_ignore(const string& ch);
+    /// Registers a char (UTF-8) which gets replaced by text
+    void add_conversion(const string& ch, const string& replacement);
+    /// Builds the lookup tables, has to be called after adding chars
+    void compile();
+
+    /// Converts text to codes, out gets cleared first.
+    /// On UNKNOWN failed holds the code point, on INVALID the byte position.
+    Status transcode(const char* text, const size_t len, vector<unsigned char>& out, uint32_t& failed) const;
+
+    /// Writes the registered lists to a snapshot
+    void save(SnapshotWriter& writer) const;
+    /// Reads the lists written by Transcoder::save and compiles them
+    void load(SnapshotReader& reader);
+    /// Hash of the registered lists, changes whenever words would convert differently
+    uint64_t fingerprint() const;
+
+    /// Decodes the first code point of UTF-8 text, returns its byte length or 0 if invalid
+    static unsigned decode_utf8(const char* text, const size_t len, uint32_t& code_point);
+    /// Checks if all of text is valid UTF-8 as accepted by Transcoder::transcode
+    static bool valid_utf8(const char* text, const size_t len);
+    /// Encodes a code point as UTF-8
+    static string encode_utf8(const uint32_t code_point);
+
+private:
+    enum Action : unsigned char { CODE, IGNORE, EXPAND, DECODE, FAIL };
+    /// What to do with a byte or code point
+    struct Entry {
+        Action action {FAIL};
+        unsigned char code {}; /// Code for CODE
+        unsigned short len {}; /// Amount of codes for EXPAND
+        unsigned offset {}; /// First code in Transcoder.expansions for EXPAND
+    };
+
+    Entry resolve(const uint32_t code_point, unsigned depth);
+    const Entry& lookup(const uint32_t code_point) const;
+
+    /// Registered lists, source of the tables
+    map<char, unsigned char> charset1;
+    map<uint32_t, unsigned char> charset2;
+    map<uint32_t, string> conversion;
+    set<char> ignore1;
+    set<uint32_t> ignore2;
+
+    /// Compiled tables
+    Entry byte_table[256];
+    vector<Entry> low_table; /// Entries of code points below LOW_LIMIT
+    vector<std::pair<uint32_t, Entry>> high_table; /// Sorted entries of all other known code points
+    vector<unsigned char> expansions; /// Codes of all conversions
+    Entry unknown; /// Entry of unregistered code points
+
+    static const uint32_t LOW_LIMIT {0x800}; /// Code points covered by low_table (up to two UTF-8 bytes)
+};
+
+#endif // TRANSCODER_H_INCLUDED
@@ -0,0 +1,115 @@
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <limits>
+#include <cstdint>
+#include "snapshot.h"
+#include "wordbook.h"
+
+using namespace std;
+
+/**
+ * @brief Creates an empty wordbook
+ */
+Wordbook::Wordbook() : own_offsets(1, 0)
+{
+    attach();
+}
+
+Wordbook::Wordbook(const Wordbook& other)
+: word_count {other.word_count}, chars {other.chars}, offsets {other.offsets},
+own_chars(other.own_chars), own_offsets(other.own_offsets), mapping(other.mapping)
+{
+    if(!mapping) attach();
+}
+
+Wordbook& Wordbook::operator=(const Wordbook& other) {
+    Wordbook copy(other);
+    return *this = move(copy);
+}
+
+/**
+ * @brief Appends a word to the end of the arena
+ * @param word The converted word
+ *
+ */
+void Wordbook::push_back(const Brainword word) {
+    if(mapping) detach();
+    if(own_chars.size() + word.size() > numeric_limits<uint32_t>::max()) {
+        cerr << "ERROR: Wordbook exceeds 4 GB!\n";
+        exit(-1);
+    }
+    own_chars.insert(own_chars.end(), word.data, word.data + word.size());
+    own_offsets.push_back(own_chars.size());
+    word_count++;
+    attach();
+}
+
+/**
+ * @brief Returns the length of the longest word
+ */
+size_t Wordbook::max_length() const {
+    size_t longest {0};
+    for(size_t i = 0; i < word_count; i++) longest = max<size_t>(longest, offsets[i + 1] - offsets[i]);
+    return longest;
+}
+
+/**
+ * @brief Points the arrays to the owned vectors
+ */
+void Wordbook::attach() {
+    chars = own_chars.data();
+    offsets = own_offsets.data();
+}
+
+/**
+ * @brief Copies mapped arrays into owned vectors and drops the mapping
+ */
+void Wordbook::detach() {
+    own_chars.assign(chars, chars + offsets[word_count]);
+    own_offsets.assign(offsets, offsets + word_count + 1);
+    mapping.reset();
+    attach();
+}
+
+/**
+ * @brief Returns bytes allocated by chars and offsets
+ */
+size_t Wordbook::memory_usage() const {
+    return own_chars.capacity() + own_offsets.capacity() * sizeof(uint32_t);
+}
+
+/**
+ * @brief Writes word count and the raw arrays
+ */
+void Wordbook::save(SnapshotWriter& writer) const {
+    writer.put<uint64_t>(word_count);
+    writer.put_array(offsets, word_count + 1);
+    writer.put_array(chars, offsets[word_count]);
+}
+
+/**
+ * @brief Points the wordbook to arrays inside a mapped snapshot
+ * @param reader Reader positioned at a wordbook written by Wordbook::save
+ * @return False if the snapshot is broken
+ *
+ */
+bool Wordbook::map(SnapshotReader& reader) {
+    const uint64_t file_words = reader.get<uint64_t>();
+    if(!reader.good()) return false;
+    const uint32_t* file_offsets = reader.get_array<uint32_t>(file_words + 1);
+    if(!reader.good() || file_offsets[0] != 0) return false;
+    for(uint64_t i = 0; i < file_words; i++) {
+        if(file_offsets[i + 1] < file_offsets[i]) return false;
+    }
+    const unsigned char* file_chars = reader.get_array<unsigned char>(file_offsets[file_words]);
+    if(!reader.good()) return false;
+
+    word_count = file_words;
+    chars = file_chars;
+    offsets = file_offsets;
+    vector<unsigned char>().swap(own_chars);
+    vector<uint32_t>().swap(own_offsets);
+    mapping = reader.mapping();
+    return true;
+}
@@ -0,0 +1,71 @@
+#ifndef WORDBOOK_H_INCLUDED
+#define WORDBOOK_H_INCLUDED
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include "snapshot.h"
+
+using std::vector;
+
+/// Non owning view of a converted word
+struct Brainword {
+    Brainword(const unsigned char* chars, const size_t len) : data {chars}, length {len} {}
+    Brainword(const vector<unsigned char>& word) : data {word.data()}, length {word.size()} {}
+
+    size_t size() const { return length; }
+    unsigned char operator[](const size_t i) const { return data[i]; }
+
+    const unsigned char* data;
+    size_t length;
+};
+
+/**
+ * @brief Converted words of one language kept in a single arena
+ *
+ * All words are stored back to back in one byte array, word i spans
+ * offsets[i] up to offsets[i + 1]. Like PatternStore a wordbook can be
+ * served from a mapped snapshot and copies the arrays on the first change.
+ *
+ */
+class Wordbook {
+public:
+    Wordbook();
+    Wordbook(const Wordbook& other);
+    Wordbook(Wordbook&& other) = default;
+    Wordbook& operator=(const Wordbook& other);
+    Wordbook& operator=(Wordbook&& other) = default;
+
+    /// Appends a word to the arena
+    void push_back(const Brainword word);
+    /// View of word i, valid until the next change
+    Brainword operator[](const size_t i) const { return Brainword(chars + offsets[i], offsets[i + 1] - offsets[i]); }
+
+    /// Amount of words
+    size_t size() const { return word_count; }
+    bool empty() const { return word_count == 0; }
+    /// Length of the longest word
+    size_t max_length() const;
+    /// Bytes allocated by the arena, mapped arrays excluded
+    size_t memory_usage() const;
+
+    /// Writes the arena to a snapshot
+    void save(SnapshotWriter& writer) const;
+    /// Serves the arena from the arrays of a snapshot without copying them
+    bool map(SnapshotReader& reader);
+
+private:
+    /// Points the arrays to the owned vectors
+    void attach();
+    /// Copies mapped arrays into owned vectors
+    void detach();
+
+    size_t word_count {0};
+    const unsigned char* chars {}; /// Chars of all words
+    const uint32_t* offsets {}; /// Start of every word plus the end of the last one
+    vector<unsigned char> own_chars; /// Storage of chars unless mapped
+    vector<uint32_t> own_offsets; /// Storage of offsets unless mapped
+    std::shared_ptr<const MappedFile> mapping; /// Snapshot the arrays point into
+};
+
+#endif // WORDBOOK_H_INCLUDED
@@ -2,52 +2,154 @@
 #include <vector>
 #include <string>
 #include <fstream>
+#include <sstream>
 #include <map>
+#include <unordered_map>
 #include <set>
 #include <limits>
 #include <chrono>
 #include <random>
+#include <algorithm>
+#include <cmath>
+#include <atomic>
+#include <cstring>
+#include <sys/stat.h>
 #include "split.h"
+#include "parallel.h"
+#include "patternstore.h"
+#include "snapshot.h"
+#include "transcoder.h"
+#include "frozenmodel.h"
+#include "staticmodel.h"
+#include "fixedrate.h"
+#include "wordbook.h"
+#include "scaletuner.h"
+#include "stats.h"
 #include "wordbooks.h"
 
 using namespace std;
 
 string Brain::base_path = "../wordbooks/";
+string Brain::wordbook_cache;
 
 /**
  * @brief Fully inits Brain class object
  *
  * Charsets and conversion list are initialized, wordbooks are imported.
  * Mind is set up to work with provided maximum word and pattern sizes.
- * Random Number generator gets initialized with current timestamp.
+ * Random streams get seeded with the given seed or the current timestamp,
+ * the seed is printed so the run can be repeated.
  *
  * @param minl, maxl, plen are passed
- * @param langli gets passed and its size is used to define init_rating and nlang
+ * @param langli gets passed and its size is used to define nlang
+ * @param workers Worker threads, also used to import the wordbooks
+ * @param seed Seed of Brain.random
  *
  */
-Brain::Brain(const unsigned minl, const unsigned maxl, const vector<string> langli, const unsigned plen)
+Brain::Brain(const unsigned minl, const unsigned maxl, const vector<string> langli, const unsigned plen, const unsigned workers,
+             const uint64_t seed)
 
 : minlength {minl}, maxlength {maxl}, langlist{langli}, nlang{static_cast<unsigned>(langlist.size())},
-init_rating(langlist.size() + 1, 0), max_pattern_len{plen}
+max_pattern_len{plen}, threads{workers}
 {
     init_charsets();
     init_ignore();
     init_conversion();
     import_wordbooks();
 
-    mind.resize(maxlength2);
+    if(max_pattern_len != 0) scale.resize(max_pattern_len, 1.0);
 
-    if(max_pattern_len == 0) scale.resize(maxlength2, 1.0);
-    else scale.resize(max_pattern_len, 1.0);
-
-    const unsigned seed = chrono::system_clock::now().time_since_epoch().count();
-    r_generator.seed(seed);
+    random.reseed(seed);
 
+    cout << "\nScoring kernel: " << score_kernel_name() << "\n";
+    cout << "Random seed: " << random.seed() << "\n";
     cout << "\nInitialization done!\n" << endl;
 }
 
 /**
- * @brief Charset1 and charset2 are initialized from specified file
+ * @brief Inits Brain class object from a model snapshot
+ *
+ * Settings, charsets, scale and Brain.mind or the compiled table are taken
+ * from the snapshot. Both are served straight from the mapped file, nothing
+ * gets imported or trained. Wordbooks can still be imported afterwards.
+ * Random streams are seeded like by the default constructor.
+ *
+ * @param model_file Snapshot written by Brain::save_model
+ * @param seed Seed of Brain.random
+ *
+ */
+Brain::Brain(const string model_file, const uint64_t seed) : Brain(SnapshotReader(model_file), seed) {}
+
+Brain::Brain(SnapshotReader&& reader, const uint64_t seed) : Brain(reader, ModelHeader::read(reader), seed) {}
+
+Brain::Brain(SnapshotReader& reader, const ModelHeader& header, const uint64_t seed)
+
+: minlength {header.minlength}, maxlength {header.maxlength}, maxlength2 {header.maxlength2}, langlist{header.langlist},
+nlang{static_cast<unsigned>(langlist.size())}, max_pattern_len{header.max_pattern_len}
+{
+    transcoder.load(reader);
+
+    scale.resize(reader.get<uint32_t>());
+    for(double& sc : scale) sc = reader.get<double>();
+
+    const uint32_t stores = reader.get<uint32_t>();
+    if(stores <= maxlength2) mind.resize(stores, PatternStore(nlang));
+    bool mapped = stores <= maxlength2;
+    for(PatternStore& store : mind) {
+        if(!(mapped = store.map(reader))) break;
+    }
+    if(mapped && reader.get<uint32_t>() != 0) mapped = compiled.map(reader, nlang);
+    if(!mapped || !reader.good()) {
+        cerr << "ERROR: Model file is broken!\n";
+        exit(-1);
+    }
+    random.reseed(seed);
+    cout << "Random seed: " << random.seed() << "\n";
+    cout << "\nModel loaded!\n" << endl;
+}
+
+/**
+ * @brief Saves settings, charsets, scale, Brain.mind and the compiled table to a snapshot file
+ *
+ * The pattern stores and the table are written as raw arrays in native
+ * byte order, so the file can be mapped by Brain(model_file) without
+ * deserializing. Once compiled, Brain.mind is released and only the table
+ * gets saved.
+ *
+ * @param model_file Path of the snapshot
+ * @return False if the file can't be written, an existing file stays as it was
+ *
+ */
+bool Brain::save_model(const string model_file) const {
+    if(!mind.empty() && !has_counts("save")) return false;
+    SnapshotWriter writer(model_file);
+    ModelHeader header;
+    header.minlength = minlength;
+    header.maxlength = maxlength;
+    header.maxlength2 = maxlength2;
+    header.max_pattern_len = max_pattern_len;
+    header.langlist = langlist;
+    header.write(writer);
+
+    transcoder.save(writer);
+
+    writer.put<uint32_t>(scale.size());
+    for(double sc : scale) writer.put(sc);
+
+    writer.put<uint32_t>(mind.size());
+    for(const PatternStore& store : mind) store.save(writer);
+    writer.put<uint32_t>(compiled.ready());
+    if(compiled.ready()) compiled.save(writer);
+    if(!writer.commit()) {
+        cerr << model_file << " can't be written!\n";
+        return false;
+    }
+    cout << "Model saved to " << model_file << "\n";
+    return true;
+}
+
+/**
+ * @brief Charsets of Brain.transcoder are initialized from specified file
  *
  */
 void Brain::init_charsets(const string csfile) {
@@ -61,21 +163,17 @@ void Brain::init_charsets(const string csfile) {
         for(unsigned char i = 0; getline(source, line); i++) {
             vector<string> characters = split(line, ':');
             for(string ch : characters) {
-                if (ch.size() == 1) charset1[ch[0]] = i;
-                else {
-                    wchar_t wch {};
-                    mbtowc(&wch, &ch[0], 6);
-                    charset2[wch] = i;
-                }
+                transcoder.add_char(ch, i);
                 cout << ch << " <-> " << static_cast<int>(i) << "\n";
             }
         }
     }
+    transcoder.compile();
     cout <<"\n";
 }
 
 /**
- * @brief Brain.ignore is initialized from specified file
+ * @brief Ignored chars of Brain.transcoder are initialized from specified file
  *
  */
 void Brain::init_ignore(const string csfile) {
@@ -88,22 +186,21 @@ void Brain::init_ignore(const string csfile) {
         string line;
         for(unsigned char i = 0; getline(source, line); i++) {
             if(line.size() == 1) {
-                ignore1.insert(line[0]);
+                transcoder.add_ignore(line);
                 cout << line[0] << " is ignored!\n";
             }
             else if(line.size() > 1) {
-                wchar_t wch {};
-                mbtowc(&wch, &line[0], 6);
-                ignore2.insert(wch);
+                transcoder.add_ignore(line);
                 cout << line << " is ignored! (wide char)\n";
             }
         }
     }
+    transcoder.compile();
     cout <<"\n";
 }
 
 /**
- * @brief Conversion is initialized from specified file
+ * @brief Conversions of Brain.transcoder are initialized from specified file
  *
  */
 void Brain::init_conversion(const string cofile) {
@@ -116,12 +213,11 @@ void Brain::init_conversion(const string cofile) {
         string orig;
         string repl;
         while(getline(source, orig, ':') && getline(source, repl, '\n')) {
-            wchar_t wch {};
-            mbtowc(&wch, &orig[0], 6);
-            conversion[wch] = repl;
+            transcoder.add_conversion(orig, repl);
             cout << orig << " <-> " << repl << "\n";
         }
     }
+    transcoder.compile();
     cout <<"\n";
 }
 
@@ -133,150 +229,487 @@ void Brain::init_conversion(const string cofile) {
  * The amount of discarded words gets counted and printed.
  * All unknow chars which occured during import are printed.
  * Also checks if randomizer is able to handle the amount of words per wb.
+ * Brain.mind and Brain.scale grow to the longest word if needed, a frozen
+ * model takes them over and a compiled table gets built again. Once
+ * compiled, Brain.mind stays released and only the scale grows.
+ * If Brain.wordbook_cache matches settings, charsets and sources, the
+ * converted words are mapped from it instead, otherwise it gets rewritten.
  *
  */
 void Brain::import_wordbooks() {
     cout << "Starting import of wordbooks\n";
-    wb.resize(langlist.size());
+    const auto start = chrono::steady_clock::now();
+    const bool cached = map_wordbook_cache();
+    vector<double> seconds(langlist.size(), 0);
+    if(!cached) {
+        wb.assign(langlist.size(), Wordbook());
+        vector<unsigned> discards(langlist.size(), 0);
+        vector<set<wchar_t>> unknown(langlist.size());
+        atomic<unsigned> next {0};
+        run_workers(min<unsigned>(resolve_workers(threads), max<size_t>(langlist.size(), 1)), [&](unsigned) {
+            for(unsigned i = next++; i < langlist.size(); i = next++) {
+                const auto lang_start = chrono::steady_clock::now();
+                import_wordbook(base_path + langlist[i] + ".txt", wb[i], discards[i], unknown[i]);
+                seconds[i] = chrono::duration<double>(chrono::steady_clock::now() - lang_start).count();
+            }
+        });
+        for(unsigned i = 0; i < langlist.size(); i++) {
+            discard_count += discards[i];
+            unidentified_chs.insert(unknown[i].begin(), unknown[i].end());
+        }
+    }
     unsigned maxwlen{};
     for(unsigned i = 0; i < langlist.size(); i++) {
-        ifstream source(base_path + langlist[i] + ".txt");
-        if (!source) {
-            cerr << langlist[i] << "can't be opened!\n";
-        }
-        else {
-            string word;
-            while(getline(source, word)) {
-                vector<unsigned char> c_word;
-                c_word = str_to_brwrd(word);
-                if(c_word[0] != KILL_CHAR) {
-                    wb[i].push_back(c_word); // Word starting with '255' are discarded
-                    if(c_word.size() > maxwlen) maxwlen = static_cast<unsigned>(c_word.size());
-                }
-                else discard_count++;
-            }
-            cout << "Language " << langlist[i] << " has got " << wb[i].size() << " Words\n";
-            if(wb[i].size() > minstd_rand::max()) {
-                cerr << "ERROR: Maximum random value is smaller than wordbook size!";
-                exit(-1);
-            }
+        cout << "Language " << langlist[i] << " has got " << wb[i].size() << " Words";
+        if(seconds[i] > 0) cout << " (" << static_cast<unsigned>(wb[i].size() / seconds[i]) << " words/sec)";
+        cout << "\n";
+        if(wb[i].size() > minstd_rand::max()) {
+            cerr << "ERROR: Maximum random value is smaller than wordbook size!";
+            exit(-1);
         }
+        maxwlen = max<unsigned>(maxwlen, wb[i].max_length());
+    }
+    const chrono::duration<double> took = chrono::steady_clock::now() - start;
+    cout << "Import took " << took.count() << "s on " << resolve_workers(threads) << " threads\n";
+    if(!cached) save_wordbook_cache();
+    maxlength2 = max(maxlength2, maxwlen);
+    const bool released = mind.empty() && compiled.ready();
+    const size_t positions = mind.size();
+    const bool grown = (!released && positions < maxlength2) || (max_pattern_len == 0 && scale.size() < maxlength2);
+    if(!released && positions < maxlength2) mind.resize(maxlength2, PatternStore(nlang));
+    if(max_pattern_len == 0 && scale.size() < maxlength2) scale.resize(maxlength2, 1.0);
+    if(grown && frozen.ready()) {
+        // The new positions are empty, so the frozen weights stay valid and the counts stay dropped
+        for(size_t j = positions; j < mind.size(); j++) mind[j].drop_counts();
+        frozen.extend(mind, scale);
     }
-    maxlength2 = maxwlen;
+    if(grown && compiled.ready() && !released) compiled.build(mind, nlang);
     if (discard_count != 0) cout <<"\n" << discard_count << " words were discarded because they included one of the following letters or had an invalid length:\n";
     ofstream source("unidentified.txt");
     for(wchar_t wch : unidentified_chs) {
-        char ch[7] {};
-        wctomb(ch,wch);
+        const string ch = Transcoder::encode_utf8(wch);
         cout << ch << " ";
         if (source) source << ch << "\n";
     }
 }
 
+/**
+ * @brief Converts all lines of a wordbook source into a wordbook
+ *
+ * The source is mapped and split into lines in place. Nothing of Brain is
+ * changed, so several sources can be imported at once.
+ *
+ * @param file Path of the source, one word per line
+ * @param words Receives the converted words
+ * @param discards Counts words which can't be converted or have an invalid length
+ * @param unknown Receives unknown chars
+ *
+ */
+void Brain::import_wordbook(const string& file, Wordbook& words, unsigned& discards, set<wchar_t>& unknown) const {
+    const MappedFile source(file);
+    if(!source.is_open()) {
+        cerr << file << " can't be opened!\n";
+        return;
+    }
+    vector<unsigned char> c_word;
+    const char* line = source.data();
+    const char* end = source.data() + source.size();
+    while(line < end) {
+        const char* line_end = static_cast<const char*>(memchr(line, '\n', end - line));
+        if(!line_end) line_end = end;
+        if(convert_word(line, line_end - line, c_word, true, unknown)) words.push_back(c_word);
+        else discards++;
+        line = line_end + 1;
+    }
+}
+
+/**
+ * @brief Returns size and modification time of every wordbook source
+ *
+ * Missing sources get -1 for both.
+ *
+ */
+vector<int64_t> Brain::wordbook_stamps() const {
+    vector<int64_t> stamps;
+    for(const string& lang : langlist) {
+        struct stat info;
+        const bool found = stat((base_path + lang + ".txt").c_str(), &info) == 0;
+        stamps.push_back(found ? info.st_size : -1);
+        stamps.push_back(found ? info.st_mtime : -1);
+    }
+    return stamps;
+}
+
+/**
+ * @brief Maps Brain.wb from Brain.wordbook_cache
+ *
+ * The cache is only used if it was written with the same lengths,
+ * languages, charsets and unchanged wordbook sources.
+ *
+ * @return False if there is no matching cache
+ *
+ */
+bool Brain::map_wordbook_cache() {
+    if(wordbook_cache.empty()) return false;
+    SnapshotReader reader(wordbook_cache);
+    if(reader.get<uint64_t>() != WORDBOOK_CACHE_MAGIC || reader.get<uint32_t>() != SNAPSHOT_VERSION) return false;
+    if(reader.get<uint32_t>() != minlength || reader.get<uint32_t>() != maxlength) return false;
+    if(reader.get<uint64_t>() != transcoder.fingerprint()) return false;
+    if(reader.get<uint32_t>() != langlist.size()) return false;
+    for(const string& lang : langlist) {
+        if(reader.get_string() != lang) return false;
+    }
+    for(int64_t stamp : wordbook_stamps()) {
+        if(reader.get<int64_t>() != stamp) return false;
+    }
+    const unsigned cached_discards = reader.get<uint32_t>();
+    set<wchar_t> cached_chs;
+    const uint32_t chs = reader.get<uint32_t>();
+    for(uint32_t i = 0; i < chs && reader.good(); i++) cached_chs.insert(reader.get<uint32_t>());
+    vector<Wordbook> cached_wb(langlist.size());
+    for(Wordbook& words : cached_wb) {
+        if(!words.map(reader)) return false;
+    }
+    if(!reader.good()) return false;
+
+    wb.swap(cached_wb);
+    discard_count += cached_discards;
+    unidentified_chs.insert(cached_chs.begin(), cached_chs.end());
+    cout << "Converted wordbooks mapped from " << wordbook_cache << "\n";
+    return true;
+}
+
+/**
+ * @brief Writes Brain.wb, discarded words and unknown chars to Brain.wordbook_cache
+ */
+void Brain::save_wordbook_cache() const {
+    if(wordbook_cache.empty()) return;
+    SnapshotWriter writer(wordbook_cache);
+    writer.put<uint64_t>(WORDBOOK_CACHE_MAGIC);
+    writer.put<uint32_t>(SNAPSHOT_VERSION);
+    writer.put<uint32_t>(minlength);
+    writer.put<uint32_t>(maxlength);
+    writer.put<uint64_t>(transcoder.fingerprint());
+    writer.put<uint32_t>(langlist.size());
+    for(const string& lang : langlist) writer.put_string(lang);
+    for(int64_t stamp : wordbook_stamps()) writer.put<int64_t>(stamp);
+    writer.put<uint32_t>(discard_count);
+    writer.put<uint32_t>(unidentified_chs.size());
+    for(wchar_t wch : unidentified_chs) writer.put<uint32_t>(wch);
+    for(const Wordbook& words : wb) words.save(writer);
+    if(!writer.commit()) cerr << wordbook_cache << " can't be written!\n";
+}
+
 /**
  * @brief Converts word to brainword which are used in Brain
  *
- * Single chars get converted as specified in charset1, charset2 and converse.
- * If unknown chars occur or the length of the word does not match the
+ * Single chars get converted as specified in the charsets and the conversion list.
+ * If unknown chars or broken UTF-8 occur or the length of the word does not match the
  * minimum or maximum length the function returns the KILL_CHAR at pos 0.
- * Chars specified in Brain.ignore are simply ignored.
+ * Chars specified in the ignore list are simply ignored.
  *
  * @param word String which gets converted
  * @param check_len specifies if words with bad length are treated or not
  * @return fully converted brainword or KILL_CHAR
  *
  */
-vector<unsigned char> Brain::str_to_brwrd(string word, bool check_len) {
+vector<unsigned char> Brain::str_to_brwrd(const string& word, bool check_len) {
     vector<unsigned char> brwrd;
-    for(size_t i = 0; i < word.size(); i++) {
-        if (charset1.find(word[i]) != charset1.end()) {
-            brwrd.push_back(charset1[word[i]]);
-        }
-        else if(ignore1.find(word[i]) != ignore1.end()) {
-            continue;
-        }
-        else {
-            wchar_t wch{};
-            int mbsize = mbtowc(&wch, &word[i], 6);
-            if (mbsize <= 0) {
-                cerr << word << " at pos " << i << " has improper multi-byte characters!";
-                exit(-1);
-            }
-            if (charset2.find(wch) != charset2.end()) {
-                brwrd.push_back(charset2[wch]);
-                i += mbsize - 1;
-            }
-            else if (ignore2.find(wch) != ignore2.end()) {
-                continue;
-            }
-            else if (conversion.find(wch) != conversion.end()) {
-                word.replace(i, mbsize, conversion[wch]);
-                i--;
-            }
-            else {
-                unidentified_chs.insert(wch);
-                //cerr << "The byte of \"" << word << "\" at pos " << i << " isn't recognized\n";
-                return vector<unsigned char> {KILL_CHAR};
-            }
-        }
+    str_to_brwrd(word, brwrd, check_len);
+    return brwrd;
+}
+
+/**
+ * @brief Converts word to brainword into a caller provided buffer
+ *
+ * @param word String which gets converted
+ * @param brwrd Receives the brainword or KILL_CHAR, its capacity is reused
+ * @param check_len specifies if words with bad length are treated or not
+ * @return False if KILL_CHAR was written
+ *
+ */
+bool Brain::str_to_brwrd(const string& word, vector<unsigned char>& brwrd, bool check_len) {
+    return convert_word(word.data(), word.size(), brwrd, check_len, unidentified_chs);
+}
+
+/**
+ * @brief Converts text to brainword without changing Brain
+ *
+ * @param text Text of the word
+ * @param len Length of text in bytes
+ * @param brwrd Receives the brainword or KILL_CHAR, its capacity is reused
+ * @param check_len specifies if words with bad length are treated or not
+ * @param unknown Receives unknown chars
+ * @return False if KILL_CHAR was written
+ *
+ */
+bool Brain::convert_word(const char* text, const size_t len, vector<unsigned char>& brwrd, bool check_len,
+                         set<wchar_t>& unknown) const {
+    uint32_t failed {};
+    const Transcoder::Status status = transcoder.transcode(text, len, brwrd, failed);
+    bool valid = status == Transcoder::OK;
+    if(status == Transcoder::UNKNOWN) unknown.insert(failed);
+    if(valid && check_len) {
+        if(brwrd.size() < minlength || brwrd.size() == 0) valid = false;
+        else if(maxlength > 0 && brwrd.size() > maxlength) valid = false;
     }
-    if(check_len) {
-        if(brwrd.size() < minlength || brwrd.size() == 0) return vector<unsigned char> {KILL_CHAR};
-        else if(maxlength > 0 && brwrd.size() > maxlength) return vector<unsigned char> {KILL_CHAR};
+    if(!valid) {
+        brwrd.assign(1, KILL_CHAR);
+        return false;
     }
     brwrd.push_back(0);
-    return brwrd;
+    return true;
 }
 
 /**
  * @brief Trains Brain.mind on a single specified word
  *
+ * A weight counts the word as often as if it was trained weight times,
+ * with a single walk through the slices.
+ *
  * @param word The word to train on
  * @param lang_index The index of the language of the word
+ * @param weight Amount of times the word was seen
  *
  */
-void Brain::train_single(vector<unsigned char> word, unsigned lang_index) {
+void Brain::train_single(const Brainword& word, unsigned lang_index, const unsigned weight) {
+    if(!has_counts("train")) return;
+    const Stats::Timer timer(stats, Stats::TRAIN_NS);
+    stats.add(Stats::WORDS_TRAINED, weight);
+    frozen.clear();
+    compiled.clear();
+    for(unsigned j = 0; j < word.size() && j < mind.size(); j++) {
+        train_position(mind[j], word, lang_index, j, weight);
+    }
+    schedule_decay(weight);
+    return;
+}
+
+/**
+ * @brief Trains all slices of a word starting at one position
+ *
+ * Slices are enumerated by walking down the trie of the position, so
+ * every longer slice costs a single edge step. If a row would saturate,
+ * the position gets halved as if that happened before the word.
+ *
+ * @param store Pattern store of the position
+ * @param word The word to train on
+ * @param lang_index The index of the language of the word
+ * @param pos Position of the slices
+ * @param weight Amount of times the word was seen
+ *
+ */
+void Brain::train_position(PatternStore& store, const Brainword& word, unsigned lang_index, unsigned pos,
+                           const unsigned weight) const {
     unsigned plen{};
     if(max_pattern_len == 0 || word.size() < max_pattern_len) plen = word.size();
     else plen = max_pattern_len;
 
-    for(unsigned i = 1; i <= plen; i++) {
-
-        for(unsigned j = 0; j <= word.size() - i; j++) {
-            vector<unsigned char> slice(&word[j],&word[j+i]);
-            if(mind[j].find(slice) == mind[j].end()) mind[j][slice] = init_rating;
-            if(mind[j][slice][0] == MAX_VAL) shrink(j,slice);
-            mind[j][slice][0] += 1;
-            mind[j][slice][lang_index + 1] += 1;
+    const unsigned reach = min<size_t>(plen, word.size() - pos);
+    unsigned node = PatternStore::NIL;
+    for(unsigned i = 1; i <= reach; i++) {
+        node = store.insert(node, word[pos + i - 1]); // extends the slice of length i - 1
+        if(!store.add(node, lang_index, weight)) {
+            // Saturated at 32 bit, the whole position is halved to keep its rows on one scale.
+            // The word is counted after the halving, so its shorter slices are taken back first
+            unsigned prefix = PatternStore::NIL;
+            for(unsigned k = 1; k < i; k++) {
+                prefix = store.find(prefix, word[pos + k - 1]);
+                store.subtract(prefix, lang_index, weight);
+            }
+            // Halved until the shortest slice, the largest row of the path, fits the word again
+            do {
+                store.decay(0.5);
+                stats.add(Stats::SHRINKS);
+                node = store.find(word.data + pos, 1);
+            } while(node != PatternStore::NIL && store.count(node, 0) > PatternStore::WIDE_MAX - weight);
+            node = PatternStore::NIL;
+            for(unsigned k = 1; k <= i; k++) {
+                node = store.insert(node, word[pos + k - 1]); // Pruning renumbers nodes
+                store.add(node, lang_index, weight);
+            }
         }
     }
-    return;
 }
 
 /**
- * @brief Shrinks specified data of Brain.mind in half
+ * @brief Trains Brain.mind on a batch of words using Brain.threads workers
  *
- * Primarily used to prevent an overflow of unsigned int.
+ * Positions are independent of each other, so every worker owns a set of
+ * positions and walks through the whole batch in order. The counts are
+ * the same as when training the words one after another, scheduled decays
+ * included, as the batch is split at every Brain.decay_every words.
+ * Frozen and compiled models get dropped.
  *
- * @param pos Position of the slice
- * @param slice Slice of a word
+ * @param words The words to train on
+ * @param langs The language index per word
+ *
+ */
+void Brain::train_batch(const vector<Brainword>& words, const vector<unsigned>& langs) {
+    if(!has_counts("train")) return;
+    const Stats::Timer timer(stats, Stats::TRAIN_NS, Stats::TRAIN_BATCH);
+    stats.add(Stats::WORDS_TRAINED, words.size());
+    frozen.clear();
+    compiled.clear();
+    const unsigned workers = resolve_workers(threads);
+    if(decay_every == 0) {
+        train_sharded(mind, words, langs, workers);
+        return;
+    }
+    // Split where Brain.decay_every is reached, so decays fall between the same words as in order
+    vector<Brainword> part;
+    vector<unsigned> part_langs;
+    for(size_t first = 0; first < words.size();) {
+        const size_t room = decay_every > trained_since_decay ? decay_every - trained_since_decay : 1;
+        const size_t last = min(words.size(), first + room);
+        part.assign(words.begin() + first, words.begin() + last);
+        part_langs.assign(langs.begin() + first, langs.begin() + last);
+        train_sharded(mind, part, part_langs, workers);
+        schedule_decay(last - first);
+        first = last;
+    }
+}
+
+/**
+ * @brief Trains a pattern store per position on a batch of words
+ *
+ * Equal words of the same language are merged first and trained once with
+ * their amount as weight, which gives the same counts. Positions get
+ * distributed by their estimated amount of slices, largest first onto the
+ * least loaded worker.
+ *
+ * @param target Pattern stores per position
+ * @param words The words to train on
+ * @param langs The language index per word
+ * @param workers Amount of worker threads
+ *
+ */
+void Brain::train_sharded(vector<PatternStore>& target, const vector<Brainword>& batch,
+                          const vector<unsigned>& batch_langs, const unsigned workers) const {
+    vector<Brainword> words;
+    vector<unsigned> langs;
+    vector<unsigned> weights;
+    merge_words(batch, batch_langs, words, langs, weights);
+    stats.add(Stats::WORDS_MERGED, batch.size() - words.size());
+
+    vector<double> work(target.size(), 0);
+    for(const Brainword& word : words) {
+        unsigned plen = word.size();
+        if(max_pattern_len != 0 && plen > max_pattern_len) plen = max_pattern_len;
+        for(unsigned j = 0; j < word.size() && j < target.size(); j++) work[j] += min<size_t>(plen, word.size() - j);
+    }
+    vector<unsigned> order(target.size());
+    for(unsigned j = 0; j < order.size(); j++) order[j] = j;
+    sort(order.begin(), order.end(), [&work](unsigned a, unsigned b) { return work[a] > work[b]; });
+
+    vector<vector<unsigned>> shards(workers);
+    vector<double> load(workers, 0);
+    for(unsigned j : order) {
+        if(work[j] == 0) break;
+        const unsigned t = min_element(load.begin(), load.end()) - load.begin();
+        shards[t].push_back(j);
+        load[t] += work[j];
+    }
+
+    run_workers(workers, [&](unsigned t) {
+        for(size_t w = 0; w < words.size(); w++) {
+            for(unsigned j : shards[t]) {
+                if(j < words[w].size()) train_position(target[j], words[w], langs[w], j, weights[w]);
+            }
+        }
+    });
+}
+
+/**
+ * @brief Merges equal words of the same language
+ *
+ * Words keep the order of their first appearance, so merged training
+ * creates the pattern nodes in the same order as training every word.
+ *
+ * @param words Words of a batch
+ * @param langs The language index per word
+ * @param merged Receives every distinct pair of word and language once
+ * @param merged_langs Receives the language index per merged word
+ * @param weights Receives how often every merged word appeared
  *
  */
-void Brain::shrink(unsigned pos, vector<unsigned char> slice) {
-    unsigned sum {0};
-    for(unsigned i = 1; i <= nlang; i++) {
-        mind[pos][slice][i] /= 2;
-        sum += mind[pos][slice][i];
+void Brain::merge_words(const vector<Brainword>& words, const vector<unsigned>& langs, vector<Brainword>& merged,
+                        vector<unsigned>& merged_langs, vector<unsigned>& weights) {
+    struct Hash {
+        size_t operator()(const pair<Brainword, unsigned>& key) const {
+            uint64_t hashed = 0xcbf29ce484222325ULL ^ key.second; // FNV-1a
+            for(size_t i = 0; i < key.first.size(); i++) hashed = (hashed ^ key.first[i]) * 0x100000001b3ULL;
+            return hashed;
+        }
+    };
+    struct Equal {
+        bool operator()(const pair<Brainword, unsigned>& a, const pair<Brainword, unsigned>& b) const {
+            return a.second == b.second && a.first.size() == b.first.size()
+                && memcmp(a.first.data, b.first.data, a.first.size()) == 0;
+        }
+    };
+    unordered_map<pair<Brainword, unsigned>, size_t, Hash, Equal> index;
+    index.reserve(words.size());
+    merged.clear();
+    merged_langs.clear();
+    weights.clear();
+    for(size_t w = 0; w < words.size(); w++) {
+        const auto found = index.emplace(make_pair(words[w], langs[w]), merged.size());
+        if(!found.second) {
+            weights[found.first->second]++;
+            continue;
+        }
+        merged.push_back(words[w]);
+        merged_langs.push_back(langs[w]);
+        weights.push_back(1);
     }
-    mind[pos][slice][0] = sum;
+}
+/**
+ * @brief Multiplies all counts of Brain.mind by a factor
+ *
+ * Older training fades out, so counts of long running training stay
+ * bounded. Positions are decayed in parallel, frozen and compiled models
+ * get dropped.
+ *
+ * @param factor Factor between 0 and 1
+ *
+ */
+void Brain::decay(const double factor) {
+    if(!has_counts("decay")) return;
+    frozen.clear();
+    compiled.clear();
+    decay_stores(mind, factor);
+}
+
+/**
+ * @brief Multiplies all counts of pattern stores by a factor using Brain.threads workers
+ */
+void Brain::decay_stores(vector<PatternStore>& stores, const double factor) const {
+    const unsigned workers = resolve_workers(threads);
+    run_workers(workers, [&](unsigned t) {
+        for(size_t j = t; j < stores.size(); j += workers) stores[j].decay(factor);
+    });
+}
+
+/**
+ * @brief Counts trained words and decays Brain.mind once Brain.decay_every is reached
+ * @param words Words trained since the last call
+ *
+ */
+void Brain::schedule_decay(const size_t words) {
+    if(decay_every == 0) return;
+    trained_since_decay += words;
+    if(trained_since_decay < decay_every) return;
+    trained_since_decay = 0;
+    decay(decay_factor);
 }
 
 /**
  * @brief Trains Brain.mind on a random word of Brain.wb
  */
 void Brain::train_random() {
-    unsigned lang_index = r_generator() % wb.size();
-    unsigned word_index = r_generator() % wb[lang_index].size();
+    unsigned lang_index = random[RandomStreams::TRAIN]() % wb.size();
+    unsigned word_index = random[RandomStreams::TRAIN]() % wb[lang_index].size();
     train_single(wb[lang_index][word_index], lang_index);
     return;
 }
@@ -286,66 +719,308 @@ void Brain::train_random() {
  * @param lang_index Given language index
  */
 void Brain::train_random(const unsigned lang_index) {
-    unsigned word_index = r_generator() % wb[lang_index].size();
+    unsigned word_index = random[RandomStreams::TRAIN]() % wb[lang_index].size();
     train_single(wb[lang_index][word_index], lang_index);
     return;
 }
 
 /**
  * @brief Trains Brain.mind on an amount of random words of Brain.wb
+ *
+ * Words are drawn in batches of Brain.batch_size and trained in parallel,
+ * the outcome matches training them one after another.
+ *
  * @param word_count Amount of random words
  */
 void Brain::train_random_bulk(const unsigned word_count) {
     cout << "Starting Training on " << word_count << " words.\n";
-    for(unsigned i = 0; i < word_count; i++) {
-        train_random();
-        if(i % polling_rate == 0) {
-            float progress = i * 100.f / word_count;
-            cout << progress << "% done" << endl;
-        }
+    const auto start = chrono::steady_clock::now();
+    vector<Brainword> words;
+    vector<unsigned> langs;
+    for(unsigned done = 0; done < word_count; done += words.size()) {
+        words.clear();
+        langs.clear();
+        if(!draw_random(min(batch_size, word_count - done), words, langs, RandomStreams::TRAIN)) return;
+        train_batch(words, langs);
+        float progress = (done + words.size()) * 100.f / word_count;
+        cout << progress << "% done" << endl;
     }
-    cout << "100% done" << endl;
+    const chrono::duration<double> took = chrono::steady_clock::now() - start;
+    cout << word_count / took.count() << " words/sec on " << resolve_workers(threads) << " threads" << endl;
     return;
 }
 
+/**
+ * @brief Prints training speed for 1 up to Brain.threads worker threads
+ *
+ * The same random words are trained into scratch pattern stores per
+ * thread count, Brain.mind stays untouched.
+ *
+ * @param word_count Amount of random words
+ *
+ */
+void Brain::train_scaling(const unsigned word_count) {
+    vector<Brainword> words;
+    vector<unsigned> langs;
+    if(!draw_random(word_count, words, langs, RandomStreams::TRAIN)) return;
+    double base_speed {};
+    for(unsigned workers = 1; workers <= resolve_workers(threads); workers++) {
+        vector<PatternStore> scratch(mind.size(), PatternStore(nlang));
+        const auto start = chrono::steady_clock::now();
+        train_sharded(scratch, words, langs, workers);
+        const chrono::duration<double> took = chrono::steady_clock::now() - start;
+        const double speed = word_count / took.count();
+        if(workers == 1) base_speed = speed;
+        cout << workers << " threads: " << speed << " words/sec (x" << speed / base_speed << ")\n";
+    }
+}
+
 /**
  * @brief Tests a single word
  *
  * A single specified word is tested against data provided from Brain.mind .
+ * Ratings are summed up per pattern length by Brain::rate_patterns and
+ * scaled afterwards.
+ * Once frozen, the frozen model rates the word instead, otherwise a
+ * compiled static table replaces Brain.mind.
  * It returns propabilities per language for the word.
  *
  * @param word Specified word to test
  * @return A vector containing propabilities for each language
  *
  */
-vector<double> Brain::test_single(vector<unsigned char> word) const {
+vector<double> Brain::test_single(const Brainword& word) const {
+    vector<double> scratch;
+    vector<double> ratings(nlang, 0);
+    test_single(word, scratch, &ratings[0]);
+    return ratings;
+}
+
+/**
+ * @brief Tests a single word using caller provided buffers
+ *
+ * @param word Specified word to test
+ * @param scratch Buffer for ratings per pattern length, reused between calls
+ * @param ratings Receives the propabilities for each language
+ *
+ */
+void Brain::test_single(const Brainword& word, vector<double>& scratch, double* ratings) const {
+    if(frozen.ready()) {
+        const unsigned hits = frozen.score(mind, word, max_pattern_len, scratch, ratings);
+        const size_t plen = max_pattern_len == 0 ? word.size() : min<size_t>(word.size(), max_pattern_len);
+        stats.add(Stats::LOOKUP_HITS, hits);
+        stats.add(Stats::LOOKUP_MISSES, plen * (word.size() - plen) + plen * (plen + 1) / 2 - hits);
+        return;
+    }
+    if(compiled.ready()) {
+        const unsigned plen = max_pattern_len == 0 ? word.size() : min<size_t>(word.size(), max_pattern_len);
+        const unsigned hits = compiled.rate(word, plen, def_rating, scratch);
+        stats.add(Stats::LOOKUP_HITS, hits);
+        stats.add(Stats::LOOKUP_MISSES, plen * (word.size() - plen) + plen * (plen + 1) / 2 - hits);
+        scale_patterns(word, plen, scratch, ratings);
+        return;
+    }
+    test_stores(mind, word, scratch, ratings);
+}
+
+/**
+ * @brief Tests a single word on given pattern stores instead of Brain.mind
+ *
+ * Used by OnlineModel to classify on its published copy of Brain.mind.
+ * Common settings are rated by a specialization of fixedrate.h unless
+ * Brain.specialized is off.
+ *
+ * @param stores Pattern stores per position
+ * @param word Specified word to test
+ * @param scratch Buffer for ratings per pattern length, reused between calls
+ * @param ratings Receives the propabilities for each language
+ *
+ */
+void Brain::test_stores(const vector<PatternStore>& stores, const Brainword& word, vector<double>& scratch,
+                        double* ratings) const {
+    const FixedRate fixed = specialized ? select_fixed_rate(padded_width(nlang), max_pattern_len, maxlength2) : nullptr;
+    if(fixed != nullptr) {
+        const unsigned hits = fixed(stores, word, nlang, def_rating, scale.data(), ratings);
+        const size_t plen = max_pattern_len == 0 ? word.size() : min<size_t>(word.size(), max_pattern_len);
+        stats.add(Stats::LOOKUP_HITS, hits);
+        stats.add(Stats::LOOKUP_MISSES, plen * (word.size() - plen) + plen * (plen + 1) / 2 - hits);
+        return;
+    }
+    const unsigned plen = rate_patterns(stores, word, scratch);
+    scale_patterns(word, plen, scratch, ratings);
+}
+
+/**
+ * @brief Scales ratings per pattern length and averages them per language
+ *
+ * @param word Rated word
+ * @param plen Amount of pattern lengths
+ * @param rating_per_pattern Rows of summed up ratings per pattern length
+ * @param ratings Receives the propabilities for each language
+ *
+ */
+void Brain::scale_patterns(const Brainword& word, const unsigned plen, const vector<double>& rating_per_pattern,
+                           double* ratings) const {
+    const unsigned width = padded_width(nlang);
+    for(unsigned k = 0; k < nlang; k++) ratings[k] = 0;
+    for(unsigned i = 1; i <= plen; i++) {
+        const double* rates_i = &rating_per_pattern[(i - 1) * width];
+        for(unsigned k = 0; k < nlang; k++) {
+            ratings[k] += scale[i-1] * (rates_i[k] / (word.size() - i + 1) - 0.5) + 0.5;
+        }
+    }
+    for(unsigned i = 0; i < nlang; i++) ratings[i] /= plen;
+}
+
+/**
+ * @brief Sums up ratings of a word per pattern length
+ *
+ * Ratings are gathered per position while walking down its trie. Hits are
+ * added up by the vectorized Brain.score_kernel, scaled by the reciprocal
+ * of the pattern's sum, misses add Brain.def_rating.
+ *
+ * @param stores Pattern stores per position, usually Brain.mind
+ * @param word Specified word to test
+ * @param rating_per_pattern Receives one row per pattern length, padded like count rows
+ * @return Amount of pattern lengths
+ *
+ */
+unsigned Brain::rate_patterns(const vector<PatternStore>& stores, const Brainword& word,
+                              vector<double>& rating_per_pattern) const {
     unsigned plen{};
     if(max_pattern_len == 0 || word.size() < max_pattern_len) plen = word.size();
     else plen = max_pattern_len;
 
-    vector<double> ratings(nlang,0);
-    for(unsigned i = 1; i <= plen; i++) {
-        vector<double> rating_per_pattern(nlang, 0);
-        for(unsigned j = 0; j <= word.size() - i; j++) {
-            vector<unsigned char> slice(&word[j],&word[j+i]);
-            if(mind[j].find(slice) != mind[j].end()) {
-                unsigned sum = mind[j].at(slice)[0];
-                for(unsigned k = 1; k <= nlang; k++) {
-                    rating_per_pattern[k-1] += static_cast<double>(mind[j].at(slice)[k]) / sum;
+    const unsigned width = padded_width(nlang);
+    rating_per_pattern.assign(plen * width, 0);
+    unsigned hits {0};
+    unsigned misses {0};
+    for(unsigned j = 0; j < word.size(); j++) {
+        const PatternStore& store = stores[j];
+        const unsigned reach = min<size_t>(plen, word.size() - j);
+        unsigned node = PatternStore::NIL;
+        for(unsigned i = 1; i <= reach; i++) {
+            double* rates_i = &rating_per_pattern[(i - 1) * width];
+            node = store.find(node, word[j + i - 1]);
+            if(node == PatternStore::NIL) {
+                // Slices are stored prefix closed, so all longer slices miss as well
+                misses += reach - i + 1;
+                for(; i <= reach; i++) {
+                    rates_i = &rating_per_pattern[(i - 1) * width];
+                    for(unsigned k = 0; k < nlang; k++) rates_i[k] += def_rating;
                 }
+                break;
             }
-            else for(unsigned k = 0; k < nlang; k++) {
-                rating_per_pattern[k] += def_rating;
+            const uint16_t* narrow = store.narrow_row(node);
+            if(narrow[0] != PatternStore::PROMOTED) narrow_kernel(rates_i, narrow + 1, width, 1.0 / narrow[0]);
+            else {
+                const unsigned* rates = store.wide_row(node);
+                score_kernel(rates_i, rates + 1, width, 1.0 / rates[0]);
             }
+            hits++;
         }
-        for(unsigned k = 0; k < nlang; k++) {
-            rating_per_pattern[k] /= word.size() - i + 1;
-            ratings[k] += scale[i-1] * (rating_per_pattern[k] - 0.5) + 0.5;
+    }
+    stats.add(Stats::LOOKUP_HITS, hits);
+    stats.add(Stats::LOOKUP_MISSES, misses);
+    return plen;
+}
+
+/**
+ * @brief Classifies a batch of words using Brain.threads workers
+ *
+ * Workers grab chunks of the batch and test them with their own scratch
+ * buffers. Brain.mind is only read, so no locking is involved.
+ * Words longer than Brain.maxlength2 are cut to it like by
+ * Brain::test_custom_word, there are no patterns beyond.
+ *
+ * @param words Words to classify
+ * @return Chosen language index and propabilities per word
+ *
+ */
+vector<Classification> Brain::classify_batch(const vector<Brainword>& words) const {
+    const Stats::Timer timer(stats, Stats::TEST_NS, Stats::CLASSIFY_BATCH);
+    stats.add(Stats::WORDS_TESTED, words.size());
+    const size_t chunk {256};
+    vector<Classification> results(words.size());
+    const unsigned workers = min<size_t>(resolve_workers(threads), (words.size() + chunk - 1) / chunk);
+    atomic<size_t> next {0};
+    run_workers(max(workers, 1u), [&](unsigned) {
+        vector<double> scratch;
+        for(size_t begin = next.fetch_add(chunk); begin < words.size(); begin = next.fetch_add(chunk)) {
+            const size_t end = min(begin + chunk, words.size());
+            for(size_t w = begin; w < end; w++) {
+                Classification& result = results[w];
+                result.scores.resize(nlang);
+                const Brainword word(words[w].data, min<size_t>(words[w].size(), maxlength2));
+                test_single(word, scratch, &result.scores[0]);
+                result.label = max_element(result.scores.begin(), result.scores.end()) - result.scores.begin();
+            }
         }
+    });
+    return results;
+}
 
+/**
+ * @brief Classifies a batch of words using Brain.threads workers
+ * @param words Words to classify
+ * @return Chosen language index and propabilities per word
+ *
+ */
+vector<Classification> Brain::classify_batch(const vector<vector<unsigned char>>& words) const {
+    return classify_batch(vector<Brainword>(words.begin(), words.end()));
+}
+
+/**
+ * @brief Draws random words of Brain.wb
+ * @param word_count Amount of random words
+ * @param words Receives the drawn words
+ * @param langs Receives the language index per word
+ * @param phase Random stream to draw from
+ * @return False if a wordbook is empty
+ *
+ */
+bool Brain::draw_random(const unsigned word_count, vector<Brainword>& words, vector<unsigned>& langs,
+                        const RandomStreams::Phase phase) {
+    if(!has_wordbooks()) return false;
+    RandomStreams::Generator& generator = random[phase];
+    for(unsigned i = 0; i < word_count; i++) {
+        const unsigned lang_index = generator() % wb.size();
+        const unsigned word_index = generator() % wb[lang_index].size();
+        words.push_back(wb[lang_index][word_index]);
+        langs.push_back(lang_index);
     }
-    for(unsigned i = 0; i < nlang; i++) ratings[i] /= plen;
-    return ratings;
+    return true;
+}
+
+/**
+ * @brief Checks that Brain.mind still holds its counts, complains if not
+ *
+ * Brain::compile releases the pattern stores, Brain::freeze drops their
+ * count rows.
+ *
+ * @param action What needs the counts, used in the complaint
+ *
+ */
+bool Brain::has_counts(const char* action) const {
+    if(mind.empty() && compiled.ready()) {
+        cerr << "Can't " << action << ", the model is compiled and holds no pattern stores!\n";
+        return false;
+    }
+    if(!mind.empty() && !mind[0].counted()) {
+        cerr << "Can't " << action << ", the model is frozen and holds no counts!\n";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Checks if words of all languages are available, complains if not
+ */
+bool Brain::has_wordbooks() const {
+    bool complete = wb.size() == nlang;
+    for(unsigned i = 0; complete && i < nlang; i++) complete = !wb[i].empty();
+    if(!complete) cerr << "Wordbooks of all languages have to be imported first!\n";
+    return complete;
 }
 
 /**
@@ -359,8 +1034,8 @@ vector<double> Brain::test_single(vector<unsigned char> word) const {
  *
  */
 unsigned Brain::test_random() {
-    const unsigned lang_index = r_generator() % wb.size();
-    const unsigned word_index = r_generator() % wb[lang_index].size();
+    const unsigned lang_index = random[RandomStreams::TEST]() % wb.size();
+    const unsigned word_index = random[RandomStreams::TEST]() % wb[lang_index].size();
     vector<double> ratings = test_single(wb[lang_index][word_index]);
     unsigned choice{0};
     for(unsigned i = 0; i<nlang; i++) {
@@ -381,7 +1056,7 @@ unsigned Brain::test_random() {
  *
  */
 unsigned Brain::test_random(const unsigned lang_index) {
-    const unsigned word_index = r_generator() % wb[lang_index].size();
+    const unsigned word_index = random[RandomStreams::TEST]() % wb[lang_index].size();
     vector<double> ratings = test_single(wb[lang_index][word_index]);
     unsigned choice{0};
     for(unsigned i = 0; i<nlang; i++) {
@@ -400,16 +1075,7 @@ void Brain::test_random_bulk(const unsigned word_count) {
     cout << "Starting Testing on " << word_count << " words.\n";
     vector<unsigned> amounts(nlang, 0);
     vector<unsigned> hits(nlang, 0);
-    for(unsigned i = 0; i < word_count; i++) {
-        unsigned result = test_random();
-        if (result >= nlang) result -= nlang;
-        else hits[result]++;
-        amounts[result]++;
-        if(i % polling_rate == 0) {
-            float progress = i * 100.f / word_count;
-            cout << progress << "% done" << endl;
-        }
-    }
+    test_random_batches(word_count, amounts, hits, true);
     cout << "100% done\n" << endl;
     unsigned overall_a {};
     unsigned overall_h {};
@@ -431,12 +1097,7 @@ void Brain::test_random_bulk(const unsigned word_count) {
 double Brain::test_random_bulk_silent(const unsigned word_count) {
     vector<unsigned> amounts(nlang, 0);
     vector<unsigned> hits(nlang, 0);
-    for(unsigned i = 0; i < word_count; i++) {
-        unsigned result = test_random();
-        if (result >= nlang) result -= nlang;
-        else hits[result]++;
-        amounts[result]++;
-    }
+    test_random_batches(word_count, amounts, hits, false);
     unsigned overall_a {};
     unsigned overall_h {};
     for(unsigned i = 0; i < nlang ; i++) {
@@ -446,6 +1107,37 @@ double Brain::test_random_bulk_silent(const unsigned word_count) {
     return 100.0 * overall_h / overall_a;
 }
 
+/**
+ * @brief Tests random words in batches of Brain.batch_size and counts hits
+ *
+ * Words are drawn on the calling thread in a fixed order, so the outcome
+ * doesn't depend on the amount of workers.
+ *
+ * @param word_count Amount of words
+ * @param amounts Tested words per language
+ * @param hits Successfully tested words per language
+ * @param verbose Prints progress per batch
+ *
+ */
+void Brain::test_random_batches(const unsigned word_count, vector<unsigned>& amounts, vector<unsigned>& hits, bool verbose) {
+    vector<Brainword> words;
+    vector<unsigned> langs;
+    for(unsigned done = 0; done < word_count; done += words.size()) {
+        words.clear();
+        langs.clear();
+        if(!draw_random(min(batch_size, word_count - done), words, langs, RandomStreams::TEST)) return;
+        const vector<Classification> results = classify_batch(words);
+        for(size_t w = 0; w < results.size(); w++) {
+            if(results[w].label == langs[w]) hits[langs[w]]++;
+            amounts[langs[w]]++;
+        }
+        if(verbose) {
+            float progress = (done + words.size()) * 100.f / word_count;
+            cout << progress << "% done" << endl;
+        }
+    }
+}
+
 /**
  * @brief Initialises small wb for testing purposes
  * @param word_count The overall amount of words in trial_wb
@@ -454,10 +1146,10 @@ double Brain::test_random_bulk_silent(const unsigned word_count) {
 void Brain::init_trial_wb(const unsigned word_count) {
     trial_wb.clear();
     trial_wb.resize(langlist.size());
+    if(!has_wordbooks()) return;
     for(unsigned i=0; i < nlang; i++) {
         for(unsigned j=0; j < word_count / nlang; j++) {
-            unsigned word_index = r_generator() % wb[i].size();
-            trial_wb[i].push_back(wb[i][word_index]);
+            trial_wb[i].push_back(random[RandomStreams::TRIAL]() % wb[i].size());
         }
     }
 }
@@ -471,13 +1163,11 @@ double Brain::test_trial() const{
     unsigned amount {0};
     unsigned hits {0};
     for(unsigned i = 0; i < nlang; i++) {
-        for(const vector<unsigned char> word : trial_wb[i]) {
-            vector<double> ratings = test_single(word);
-            unsigned choice{0};
-            for(unsigned j = 0; j<nlang; j++) {
-                if(ratings[j] > ratings[choice]) choice = j;
-            }
-            if(choice == i) hits++;
+        vector<Brainword> words;
+        words.reserve(trial_wb[i].size());
+        for(unsigned word_index : trial_wb[i]) words.push_back(wb[i][word_index]);
+        for(const Classification& result : classify_batch(words)) {
+            if(result.label == i) hits++;
             amount++;
         }
     }
@@ -524,12 +1214,26 @@ void Brain::test_custom_slice(string word, unsigned pos) {
     if(slice[0] == KILL_CHAR) cout << "Invalid String given!\n";
     else {
         slice.pop_back();
+        if(!mind.empty() && !has_counts("rate slices")) return;
         //string sl_word = brwrd_to_str(slice);
         //cout << string(pos, '_') << sl_word << "is being tested\n";
-        if(mind[pos].find(slice) != mind[pos].end()) {
-            unsigned sum = mind[pos].at(slice)[0];
+        if(compiled.ready()) {
+            const unsigned record = compiled.find(pos, slice.data(), slice.size());
+            if(record != StaticModel::NONE) {
+                unsigned sum = compiled.count(record, 0);
+                for(unsigned i = 1; i <= nlang; i++) {
+                    double chance = static_cast<double>(compiled.count(record, i)) / sum;
+                    cout << langlist[i - 1] << " chance: " << chance * 100 << "%\n";
+                }
+            }
+            else cout << "slice not available!\n";
+            return;
+        }
+        const unsigned node = pos < mind.size() ? mind[pos].find(slice.data(), slice.size()) : PatternStore::NIL;
+        if(node != PatternStore::NIL) {
+            unsigned sum = mind[pos].count(node, 0);
             for(unsigned i = 1; i <= nlang; i++) {
-                double chance = static_cast<double>(mind[pos].at(slice)[i]) / sum;
+                double chance = static_cast<double>(mind[pos].count(node, i)) / sum;
                 cout << langlist[i - 1] << " chance: " << chance * 100 << "%\n";
             }
         }
@@ -547,6 +1251,8 @@ void Brain::test_custom_slice(string word, unsigned pos) {
  * It increases scaling of specified pattern ranges individually and checks
  * if the succes rates rise. It stops upon worse or same success rates and
  * changes back to previous step.
+ * Candidates are evaluated on cached ratings of the trial words, several
+ * steps ahead at once, so only the search itself is sequential.
  * It prints all values during testing and the final scale values at the end.
  *
  * @param word_count Amount of words used per testing (more means less randomness)
@@ -556,18 +1262,26 @@ void Brain::test_custom_slice(string word, unsigned pos) {
  *
  */
 void Brain::autoset_scale(unsigned word_count, unsigned pmin,unsigned pmax, double step) {
+    if(!has_counts("tune the scale")) return;
+    const unsigned ahead {16};
     init_trial_wb(word_count);
+    const ScaleTuner tuner = trial_tuner();
+    pmax = min<unsigned>(pmax, scale.size());
     for(unsigned i=pmin - 1; i < pmax; i++) {
-        double success_new = test_trial();
-        double success_old;
-        cout << success_new << " at " << scale[i] << "  " << i+1 << "-patterns\n";
-        do {
-            success_old = success_new;
-            scale[i] += step;
-            success_new = test_trial();
-            cout << success_new << " at " << scale[i] << "  " << i+1 << "-patterns\n";
-        } while(success_new > success_old);
-        scale[i] -= step;
+        double success_old = tuner.success(scale);
+        cout << success_old << " at " << scale[i] << "  " << i+1 << "-patterns\n";
+        bool rising = true;
+        while(rising) {
+            vector<double> candidates(ahead);
+            for(unsigned c = 0; c < ahead; c++) candidates[c] = scale[i] + (c + 1) * step;
+            const vector<double> success = tuner.sweep(scale, {i + 1}, candidates)[0];
+            for(unsigned c = 0; c < ahead && rising; c++) {
+                cout << success[c] << " at " << candidates[c] << "  " << i+1 << "-patterns\n";
+                rising = success[c] > success_old;
+                success_old = success[c];
+                if(rising) set_scale(i + 1, candidates[c]);
+            }
+        }
         cout << "\n";
     }
     cout << "\n";
@@ -576,12 +1290,348 @@ void Brain::autoset_scale(unsigned word_count, unsigned pmin,unsigned pmax, doub
     }
 }
 
+/**
+ * @brief Caches the pattern ratings of all words in trial_wb
+ *
+ * Words are rated in parallel by Brain.threads workers.
+ *
+ * @return Tuner over trial_wb
+ *
+ */
+ScaleTuner Brain::trial_tuner() const {
+    vector<Brainword> words;
+    vector<unsigned> plens;
+    vector<unsigned> labels;
+    for(unsigned i = 0; i < trial_wb.size(); i++) {
+        for(unsigned word_index : trial_wb[i]) {
+            words.push_back(wb[i][word_index]);
+            plens.push_back(max_pattern_len == 0 ? words.back().size() : min<size_t>(words.back().size(), max_pattern_len));
+            labels.push_back(i);
+        }
+    }
+    ScaleTuner tuner(nlang, plens, labels, resolve_workers(threads));
+    const size_t chunk {256};
+    const unsigned width = padded_width(nlang);
+    atomic<size_t> next {0};
+    run_workers(resolve_workers(threads), [&](unsigned) {
+        vector<double> rating_per_pattern;
+        for(size_t begin = next.fetch_add(chunk); begin < words.size(); begin = next.fetch_add(chunk)) {
+            for(size_t w = begin; w < min(begin + chunk, words.size()); w++) {
+                const unsigned plen = rate_patterns(mind, words[w], rating_per_pattern);
+                for(unsigned i = 1; i <= plen; i++) {
+                    double* terms = tuner.terms(w, i);
+                    for(unsigned k = 0; k < nlang; k++) {
+                        terms[k] = rating_per_pattern[(i - 1) * width + k] / (words[w].size() - i + 1) - 0.5;
+                    }
+                }
+            }
+        }
+    });
+    return tuner;
+}
+
+/**
+ * @brief Sets the scale of one pattern length
+ *
+ * A frozen model only gets its factor of that length updated.
+ *
+ * @param plen Pattern length
+ * @param value New scale
+ *
+ */
+void Brain::set_scale(unsigned plen, double value) {
+    if(plen == 0 || plen > scale.size()) return;
+    scale[plen - 1] = value;
+    frozen.rescale(plen, value);
+}
+
+/**
+ * @brief Freezes Brain.mind into a model of normalized weights
+ *
+ * The weights replace the count rows of Brain.mind, only its tries are
+ * kept for finding patterns. The model can't be trained, saved or frozen
+ * again afterwards.
+ *
+ * @param precision Float weights or 16 / 8 bit quantized weights
+ *
+ */
+void Brain::freeze(const FrozenModel::Precision precision) {
+    if(!has_counts("freeze")) return;
+    const auto start = chrono::steady_clock::now();
+    frozen.freeze(mind, nlang, scale, def_rating, precision);
+    size_t count_bytes {0};
+    size_t trie_bytes {0};
+    for(PatternStore& store : mind) {
+        count_bytes += store.count_bytes();
+        store.drop_counts();
+        trie_bytes += store.footprint();
+    }
+    const chrono::duration<double> took = chrono::steady_clock::now() - start;
+    cout << "Frozen (" << FrozenModel::precision_name(precision) << ") in " << took.count() << "s, weights use "
+         << frozen.memory_usage() / 1'000'000 << " MB in place of " << count_bytes / 1'000'000 << " MB of counts, tries use "
+         << trie_bytes / 1'000'000 << " MB\n";
+}
+
+/**
+ * @brief Compiles Brain.mind into a static minimal perfect hash table and releases Brain.mind
+ *
+ * Testing uses the table from then on, a frozen model is dropped. Without
+ * pattern stores the model can't be trained, frozen or compacted anymore,
+ * Brain::save_model saves the table instead. Prints the memory of the
+ * table next to the released footprint of Brain.mind.
+ *
+ */
+void Brain::compile() {
+    if(!has_counts("compile")) return;
+    const auto start = chrono::steady_clock::now();
+    compiled.build(mind, nlang);
+    const chrono::duration<double> took = chrono::steady_clock::now() - start;
+    size_t mind_bytes {0};
+    for(const PatternStore& store : mind) mind_bytes += store.footprint();
+    frozen.clear();
+    vector<PatternStore>().swap(mind);
+    cout << "Compiled " << compiled.size() << " patterns in " << took.count() << "s, table uses "
+         << compiled.memory_usage() / 1'000'000 << " MB, released stores of " << mind_bytes / 1'000'000 << " MB\n";
+}
+
+/**
+ * @brief Drops patterns which hardly change the ratings
+ *
+ * A pattern is dropped if it was seen less than min_count times, if its
+ * normalized entropy over the languages exceeds max_entropy (rating it is
+ * close to rating a miss with Brain.def_rating) or if it isn't among the
+ * top_k most frequent patterns of its position. Patterns with a kept
+ * longer pattern below them stay, so every store remains prefix closed.
+ * Prints patterns, memory and success on trial_wb before and after.
+ *
+ * @param options Criteria of dropped patterns
+ * @param word_count Amount of words in trial_wb
+ * @param apply False restores Brain.mind after reporting
+ *
+ */
+void Brain::compact(const CompactOptions& options, const unsigned word_count, const bool apply) {
+    if(!has_counts("compact")) return;
+    init_trial_wb(word_count);
+    const bool was_frozen = frozen.ready();
+    const FrozenModel::Precision precision = frozen.get_precision();
+    const bool was_compiled = compiled.ready();
+    frozen.clear();
+    compiled.clear();
+    const auto measure = [this](size_t& patterns, size_t& bytes) {
+        patterns = 0;
+        bytes = 0;
+        for(const PatternStore& store : mind) {
+            patterns += store.size();
+            bytes += store.footprint();
+        }
+    };
+    size_t patterns_before, bytes_before, patterns_after, bytes_after;
+    measure(patterns_before, bytes_before);
+    const bool testable = !trial_wb.empty() && !trial_wb[0].empty();
+    const double success_before = testable ? test_trial() : 0;
+    vector<PatternStore> backup;
+    if(!apply) backup = mind;
+
+    const double log_nlang = log(nlang);
+    run_workers(resolve_workers(threads), [&](unsigned t) {
+        for(size_t j = t; j < mind.size(); j += resolve_workers(threads)) {
+            PatternStore& store = mind[j];
+            const size_t nodes = store.size() + 1;
+            const vector<unsigned> parent = store.parents();
+            vector<bool> keep(nodes, false);
+            vector<bool> needed(nodes, false); // A longer pattern below is kept
+            for(size_t node = nodes - 1; node > 0; node--) {
+                const unsigned sum = store.count(node, 0);
+                double entropy {0};
+                for(unsigned k = 1; k <= nlang; k++) {
+                    const unsigned count = store.count(node, k);
+                    if(count == 0) continue;
+                    const double p = static_cast<double>(count) / sum;
+                    entropy -= p * log(p);
+                }
+                const bool useful = sum >= options.min_count && (nlang < 2 || entropy / log_nlang <= options.max_entropy);
+                keep[node] = useful || needed[node];
+                if(keep[node]) needed[parent[node]] = true;
+            }
+            if(options.top_k != 0) {
+                vector<unsigned> order;
+                for(unsigned node = 1; node < nodes; node++) {
+                    if(keep[node]) order.push_back(node);
+                }
+                stable_sort(order.begin(), order.end(), [&store](unsigned a, unsigned b) {
+                    return store.count(a, 0) > store.count(b, 0);
+                });
+                vector<bool> top(nodes, false);
+                size_t kept {0};
+                for(size_t o = 0; o < order.size() && kept < options.top_k; o++) {
+                    for(unsigned node = order[o]; node != PatternStore::NIL && !top[node]; node = parent[node]) {
+                        top[node] = true; // Ancestors come along to stay prefix closed
+                        kept++;
+                    }
+                }
+                keep.swap(top);
+            }
+            store.prune(keep);
+        }
+    });
+
+    measure(patterns_after, bytes_after);
+    cout << "Patterns: " << patterns_before << " -> " << patterns_after << "\n";
+    cout << "Memory: " << bytes_before / 1'000'000 << " MB -> " << bytes_after / 1'000'000 << " MB (saved "
+         << (bytes_before - bytes_after) / 1'000'000 << " MB)\n";
+    if(testable) {
+        const double success_after = test_trial();
+        cout << "Success: " << success_before << "% -> " << success_after << "% (" << success_after - success_before << ")\n";
+    }
+    if(!apply) {
+        mind.swap(backup);
+        cout << "Model restored\n";
+    }
+    if(was_frozen) frozen.freeze(mind, nlang, scale, def_rating, precision);
+    if(was_compiled) compiled.build(mind, nlang);
+}
+
+/**
+ * @brief Prints how often slices of each length miss Brain.mind
+ *
+ * Walks the slices of the words in trial_wb like rate_patterns. Once a
+ * slice misses, all longer slices at its position miss without a lookup,
+ * as stores are prefix closed. Filtered is the share of looked up misses
+ * rejected by the Bloom filter of a store without probing its slots.
+ *
+ * @param word_count Amount of words in trial_wb
+ *
+ */
+void Brain::report_lookups(const unsigned word_count) {
+    if(!has_counts("report lookups")) return;
+    init_trial_wb(word_count);
+    vector<size_t> slices, missed, lookups, looked_up_misses, filtered;
+    for(unsigned l = 0; l < nlang; l++) {
+        for(unsigned word_index : trial_wb[l]) {
+            const Brainword& word = wb[l][word_index];
+            const unsigned plen = max_pattern_len == 0 || word.size() < max_pattern_len ? word.size() : max_pattern_len;
+            if(slices.size() < plen) {
+                for(vector<size_t>* column : {&slices, &missed, &lookups, &looked_up_misses, &filtered}) column->resize(plen, 0);
+            }
+            for(unsigned j = 0; j < word.size(); j++) {
+                const PatternStore& store = mind[j];
+                const unsigned reach = min<size_t>(plen, word.size() - j);
+                unsigned node = PatternStore::NIL;
+                for(unsigned i = 1; i <= reach; i++) {
+                    slices[i - 1]++;
+                    if(i > 1 && node == PatternStore::NIL) {
+                        missed[i - 1]++;
+                        continue;
+                    }
+                    lookups[i - 1]++;
+                    const unsigned parent = node;
+                    node = store.find(parent, word[j + i - 1]);
+                    if(node != PatternStore::NIL) continue;
+                    missed[i - 1]++;
+                    looked_up_misses[i - 1]++;
+                    if(!store.may_contain(parent, word[j + i - 1])) filtered[i - 1]++;
+                }
+            }
+        }
+    }
+    const auto percent = [](const size_t part, const size_t whole) {
+        return whole == 0 ? 0.0 : round(1000.0 * part / whole) / 10;
+    };
+    cout << "Length\tSlices\tMissed\tLookups\tFiltered\n";
+    for(size_t i = 0; i < slices.size(); i++) {
+        cout << i + 1 << "\t" << slices[i] << "\t" << percent(missed[i], slices[i]) << "%\t" << lookups[i] << "\t"
+             << percent(filtered[i], looked_up_misses[i]) << "%\n";
+    }
+}
+
+/**
+ * @brief Returns runtime statistics and model sizes as JSON
+ *
+ * Holds the counters and histograms of Brain.stats, discarded words,
+ * patterns per position and per length and the memory used by Brain.mind,
+ * the frozen model and Brain.wb. Count bytes include mapped stores.
+ *
+ */
+string Brain::stats_json() const {
+    ostringstream out;
+    out << "{\n  \"runtime\": " << stats.json() << ",\n";
+    out << "  \"discarded_words\": " << discard_count << ",\n";
+    vector<size_t> per_length;
+    size_t patterns {0};
+    size_t owned_bytes {0};
+    size_t count_bytes {0};
+    size_t promoted {0};
+    out << "  \"patterns_per_position\": [";
+    for(size_t j = 0; j < mind.size(); j++) {
+        out << (j == 0 ? "" : ", ") << mind[j].size();
+        patterns += mind[j].size();
+        owned_bytes += mind[j].memory_usage();
+        count_bytes += mind[j].count_bytes();
+        promoted += mind[j].promoted();
+        const vector<size_t> lengths = mind[j].count_per_length();
+        if(per_length.size() < lengths.size()) per_length.resize(lengths.size(), 0);
+        for(size_t i = 0; i < lengths.size(); i++) per_length[i] += lengths[i];
+    }
+    out << "],\n  \"patterns_per_length\": [";
+    for(size_t i = 0; i < per_length.size(); i++) out << (i == 0 ? "" : ", ") << per_length[i];
+    out << "],\n  \"patterns\": " << patterns << ",\n";
+    out << "  \"mind_count_bytes\": " << count_bytes << ",\n";
+    out << "  \"promoted_rows\": " << promoted << ",\n";
+    out << "  \"mind_owned_bytes\": " << owned_bytes << ",\n";
+    out << "  \"frozen_bytes\": " << frozen.memory_usage() << ",\n";
+    out << "  \"static_bytes\": " << compiled.memory_usage() << ",\n";
+    size_t words {0};
+    size_t wb_bytes {0};
+    for(const Wordbook& words_of_lang : wb) {
+        words += words_of_lang.size();
+        wb_bytes += words_of_lang.memory_usage();
+    }
+    out << "  \"wordbook_words\": " << words << ",\n";
+    out << "  \"wordbook_bytes\": " << wb_bytes << "\n}\n";
+    return out.str();
+}
+
+/**
+ * @brief Compares the precisions of frozen models on trial_wb
+ *
+ * Prints the success rate, the memory of the weights and the memory of
+ * the whole model for the counts and each precision. A frozen model only
+ * keeps the tries of Brain.mind next to its weights, the counted model
+ * needs tries and count rows. Brain.mind stays unfrozen.
+ *
+ * @param word_count Amount of words in trial_wb
+ *
+ */
+void Brain::compare_precisions(const unsigned word_count) {
+    if(!has_counts("freeze")) return;
+    init_trial_wb(word_count);
+
+    size_t count_bytes {0};
+    size_t trie_bytes {0};
+    for(const PatternStore& store : mind) {
+        count_bytes += store.count_bytes();
+        trie_bytes += store.footprint() - store.count_bytes();
+    }
+    frozen.clear();
+    cout << "counts    " << test_trial() << "% success, weights " << count_bytes / 1'000'000 << " MB, model "
+         << (trie_bytes + count_bytes) / 1'000'000 << " MB\n";
+    for(FrozenModel::Precision precision : {FrozenModel::FLOAT32, FrozenModel::UINT16, FrozenModel::UINT8}) {
+        frozen.freeze(mind, nlang, scale, def_rating, precision);
+        cout << FrozenModel::precision_name(precision) << "   " << test_trial() << "% success, weights "
+             << frozen.memory_usage() / 1'000'000 << " MB, model " << (trie_bytes + frozen.memory_usage()) / 1'000'000
+             << " MB\n";
+    }
+    frozen.clear();
+}
+
 /**
  * @brief Tests scale values per pattern size
  *
  * The test basis is trial_wb to ensure minimal randomness during testing.
  * It increases scaling of specified pattern ranges individually and tests.
- * Then it changes back to the old values.
+ * The scale itself stays unchanged.
+ * All pattern lengths and values are evaluated in one parallel pass over
+ * cached ratings of the trial words.
  * It prints all values during testing.
  *
  * @param word_count Amount of words used per testing (more means less randomness)
@@ -593,16 +1643,18 @@ void Brain::autoset_scale(unsigned word_count, unsigned pmin,unsigned pmax, doub
  *
  */
 void Brain::test_scale(unsigned word_count, unsigned pmin, unsigned pmax, double step, double smin, double smax) {
+    if(!has_counts("test the scale")) return;
     init_trial_wb(word_count);
-    for(unsigned i=pmin - 1; i < pmax; i++) {
-        double old_sc = scale[i];
-        double success;
-        for(double j = smin; j <= smax; j += step) {
-            scale[i] = j;
-            success = test_trial();
-            cout << success << " at " << scale[i] << "  " << i+1 << "-patterns\n";
-        }
-        scale[i] = old_sc;
+    const ScaleTuner tuner = trial_tuner();
+    vector<unsigned> plens;
+    for(unsigned i = pmin; i <= pmax && i <= scale.size(); i++) plens.push_back(i);
+    vector<double> candidates;
+    for(double j = smin; j <= smax; j += step) candidates.push_back(j);
+    const vector<vector<double>> success = tuner.sweep(scale, plens, candidates);
+    for(size_t p = 0; p < plens.size(); p++) {
+        for(size_t c = 0; c < candidates.size(); c++) {
+            cout << success[p][c] << " at " << candidates[c] << "  " << plens[p] << "-patterns\n";
+        }
         cout << "\n";
     }
 }
@@ -611,6 +1663,7 @@ void Brain::test_scale(unsigned word_count, unsigned pmin, unsigned pmax, double
  * @brief Trains on all words in specified file
  *
  * Reads line by line, word by word and trains only on valid words within min- and maxlength.
+ * Words are collected in batches of Brain.batch_size and trained in parallel.
  *
  * @param file Specified file without .txt, which hast to be utf-8
  * @param lang_index The index of the correspondig language of the file
@@ -623,27 +1676,46 @@ void Brain::train_on_file(const string file, const unsigned lang_index) {
         cerr << file <<" can't be opened!\n";
     }
     else {
-        vector<double> ratings(nlang, 0);
+        const auto start = chrono::steady_clock::now();
+        vector<vector<unsigned char>> batch;
         string line;
         unsigned counter {0};
         for(unsigned i = 1; getline(source, line); i++) {
             vector<string> word_list = split(line, ' ');
             for(string word : word_list) {
-                vector<unsigned char> brwrd = str_to_brwrd(word);
-                if(brwrd[0] == KILL_CHAR) continue;
-                train_single(brwrd, lang_index);
+                batch.emplace_back();
+                if(!str_to_brwrd(word, batch.back())) {
+                    batch.pop_back();
+                    continue;
+                }
                 counter++;
-                if(counter % polling_rate == 0) cout << i << " lines and " << counter << " words trained\n";
+                if(counter % polling_rate == 0) cout << i << " lines and " << counter << " words read\n";
+                if(batch.size() == batch_size) train_file_batch(batch, lang_index);
             }
         }
+        train_file_batch(batch, lang_index);
+        const chrono::duration<double> took = chrono::steady_clock::now() - start;
         cout << counter << " words trained\n";
+        cout << counter / took.count() << " words/sec on " << resolve_workers(threads) << " threads\n";
     }
 }
 
+/**
+ * @brief Trains on collected words of a file and clears them
+ * @param batch Collected words
+ * @param lang_index The index of the correspondig language of the words
+ *
+ */
+void Brain::train_file_batch(vector<vector<unsigned char>>& batch, const unsigned lang_index) {
+    train_batch(vector<Brainword>(batch.begin(), batch.end()), vector<unsigned>(batch.size(), lang_index));
+    batch.clear();
+}
+
 /**
  * @brief Tests on all words in specified file
  *
  * Reads line by line, word by word and tests on all words. Words which are too long ar cut down to maxlength.
+ * Words are collected in batches of Brain.batch_size and classified in parallel.
  * Prints rates per language and choice.
  *
  * @param file Specified file without .txt, which hast to be utf-8
@@ -657,23 +1729,24 @@ void Brain::test_on_file(const string file) {
     }
     else {
         vector<double> ratings(nlang, 0);
+        vector<vector<unsigned char>> batch;
         string line;
         unsigned counter {0};
         for(unsigned i = 1; getline(source, line); i++) {
             vector<string> word_list = split(line, ' ');
             for(string word : word_list) {
-                vector<unsigned char> brwrd = str_to_brwrd(word, false);
-                if(brwrd[0] == KILL_CHAR) continue;
-                if (brwrd.size() > maxlength2) {
-                    vector<unsigned char> temp(&brwrd[0],&brwrd[maxlength2]);
-                    brwrd = temp;
+                batch.emplace_back();
+                if(!str_to_brwrd(word, batch.back(), false)) {
+                    batch.pop_back();
+                    continue;
                 }
-                vector<double> rates = test_single(brwrd);
-                for(unsigned j = 0; j < nlang; j++) ratings[j] += rates[j];
+                if (batch.back().size() > maxlength2) batch.back().resize(maxlength2);
                 counter++;
-                if(counter % polling_rate == 0) cout << i << " lines and " << counter << " words tested\n";
+                if(counter % polling_rate == 0) cout << i << " lines and " << counter << " words read\n";
+                if(batch.size() == batch_size) test_file_batch(batch, ratings);
             }
         }
+        test_file_batch(batch, ratings);
         cout << counter << " words tested\n\n";
         unsigned choice {0};
         for(unsigned i = 0; i < nlang; i++) {
@@ -683,3 +1756,192 @@ void Brain::test_on_file(const string file) {
         cout << "\n I choose " << langlist[choice] << " !\n";
     }
 }
+
+/**
+ * @brief Classifies a document, stops once the decision is settled
+ *
+ * Words are read and rated in small batches, their rates are added up one
+ * word after another. After min_tokens words the classification stops as
+ * soon as the mean rate of the leading language exceeds the runner-up by
+ * confidence. Lines after that point are never read, so a file can be
+ * sampled by its beginning.
+ *
+ * @param in Text of the document
+ * @param confidence Margin of mean rates to stop at, 0 or less reads everything
+ * @param min_tokens Words to read at least before stopping
+ * @param max_tokens Words to read at most, 0 is unlimited
+ * @return Decision, its confidence and the amount of words used
+ *
+ */
+DocumentClassification Brain::classify_document(istream& in, const double confidence, const unsigned min_tokens,
+                                                const unsigned max_tokens) {
+    const size_t chunk {64};
+    DocumentClassification result;
+    vector<double> sums(nlang, 0);
+    vector<vector<unsigned char>> batch;
+    string line;
+    bool done {false};
+    const auto rate_batch = [&]() {
+        const vector<Classification> words = classify_batch(batch);
+        for(size_t w = 0; w < words.size(); w++) {
+            for(unsigned k = 0; k < nlang; k++) sums[k] += words[w].scores[k];
+            result.tokens++;
+            vector<double> sorted = sums;
+            partial_sort(sorted.begin(), sorted.begin() + min(2u, nlang), sorted.end(), greater<double>());
+            result.confidence = nlang > 1 ? (sorted[0] - sorted[1]) / result.tokens : 1;
+            if((confidence > 0 && result.tokens >= min_tokens && result.confidence >= confidence)
+               || (max_tokens != 0 && result.tokens >= max_tokens)) {
+                done = true;
+                result.early = w + 1 < words.size();
+                break;
+            }
+        }
+        batch.clear();
+    };
+    while(!done && getline(in, line)) {
+        if(!line.empty() && line.back() == '\r') line.pop_back();
+        for(const string& word : split(line, ' ')) {
+            if(word.empty()) continue;
+            batch.emplace_back();
+            if(!str_to_brwrd(word, batch.back(), false)) {
+                batch.pop_back();
+                continue;
+            }
+            if (batch.back().size() > maxlength2) batch.back().resize(maxlength2);
+        }
+        if(batch.size() >= chunk) rate_batch();
+    }
+    if(!done) rate_batch();
+    result.early = result.early || (done && in.peek() != char_traits<char>::eof());
+    result.label = max_element(sums.begin(), sums.end()) - sums.begin();
+    result.scores = sums;
+    for(double& score : result.scores) score /= max(result.tokens, 1u);
+    return result;
+}
+
+/**
+ * @brief Classifies a file as one document and prints the decision
+ *
+ * @param file Specified file without .txt, which hast to be utf-8
+ * @param confidence Margin of mean rates to stop at
+ *
+ */
+void Brain::test_document(const string file, const double confidence) {
+    ifstream source("../" + file + ".txt");
+    if (!source) {
+        cerr << file <<" can't be opened!\n";
+        return;
+    }
+    const auto start = chrono::steady_clock::now();
+    const DocumentClassification result = classify_document(source, confidence);
+    const chrono::duration<double> took = chrono::steady_clock::now() - start;
+    for(unsigned i = 0; i < nlang; i++) cout << langlist[i] << " success: " << result.scores[i] * 100 << "%\n";
+    cout << "\n I choose " << langlist[result.label] << " with confidence " << result.confidence << " after "
+         << result.tokens << " words" << (result.early ? " (stopped early)" : "") << " in " << took.count() << "s !\n";
+}
+
+/**
+ * @brief Classifies a stream of text line by line
+ *
+ * Each line is split into words like Brain::test_on_file, its words are
+ * rated by test_single and their rates are averaged. Lines are collected
+ * until Brain.batch_size words are reached, classified in parallel and
+ * written in one go as "label<TAB>rate rate ...". Lines without a valid
+ * word get "-" as label and no rates.
+ *
+ * @param in Newline delimited text
+ * @param out Receives one line per line of in
+ *
+ */
+void Brain::classify_stream(istream& in, ostream& out) {
+    vector<vector<unsigned char>> batch;
+    vector<size_t> line_ends; // End of the words of each line in batch
+    string line;
+    string results;
+    const auto flush_batch = [&]() {
+        format_lines(classify_batch(batch), line_ends, results);
+        out.write(results.data(), results.size());
+        results.clear();
+        batch.clear();
+        line_ends.clear();
+    };
+    while(getline(in, line)) {
+        convert_line(line, batch, unidentified_chs);
+        line_ends.push_back(batch.size());
+        if(batch.size() >= batch_size) flush_batch();
+    }
+    flush_batch();
+    out.flush();
+}
+
+/**
+ * @brief Converts the words of a line and appends them to a batch
+ *
+ * Words are split at spaces, invalid ones are skipped and long ones cut
+ * to Brain.maxlength2. A line with broken UTF-8 gets no words at all, so
+ * it is answered with "-" and the stream goes on.
+ *
+ * @param line Line of text, a trailing carriage return is ignored
+ * @param batch Receives the brainwords
+ * @param unknown Receives unknown chars
+ *
+ */
+void Brain::convert_line(string line, vector<vector<unsigned char>>& batch, set<wchar_t>& unknown) const {
+    if(!line.empty() && line.back() == '\r') line.pop_back();
+    if(!Transcoder::valid_utf8(line.data(), line.size())) return;
+    for(const string& word : split(line, ' ')) {
+        if(word.empty()) continue;
+        batch.emplace_back();
+        if(!convert_word(word.data(), word.size(), batch.back(), false, unknown)) {
+            batch.pop_back();
+            continue;
+        }
+        if (batch.back().size() > maxlength2) batch.back().resize(maxlength2);
+    }
+}
+
+/**
+ * @brief Appends the results of classified lines as "label<TAB>rate rate ..."
+ *
+ * Rates of the words of a line are averaged, lines without a valid word
+ * get "-" as label and no rates.
+ *
+ * @param classes Classified words of all lines
+ * @param line_ends End of the words of each line in classes
+ * @param results Receives one line per line
+ *
+ */
+void Brain::format_lines(const vector<Classification>& classes, const vector<size_t>& line_ends, string& results) const {
+    vector<double> rates(nlang);
+    size_t w {0};
+    for(size_t line_end : line_ends) {
+        if(w == line_end) {
+            results += "-\n";
+            continue;
+        }
+        fill(rates.begin(), rates.end(), 0);
+        const size_t words = line_end - w;
+        for(; w < line_end; w++) {
+            for(unsigned k = 0; k < nlang; k++) rates[k] += classes[w].scores[k];
+        }
+        results += langlist[max_element(rates.begin(), rates.end()) - rates.begin()];
+        for(unsigned k = 0; k < nlang; k++) {
+            results += k == 0 ? '\t' : ' ';
+            results += to_string(rates[k] / words);
+        }
+        results += '\n';
+    }
+}
+
+/**
+ * @brief Classifies collected words of a file, adds up their rates and clears them
+ * @param batch Collected words
+ * @param ratings Summed up rates per language
+ *
+ */
+void Brain::test_file_batch(vector<vector<unsigned char>>& batch, vector<double>& ratings) const {
+    for(const Classification& result : classify_batch(batch)) {
+        for(unsigned j = 0; j < nlang; j++) ratings[j] += result.scores[j];
+    }
+    batch.clear();
+}
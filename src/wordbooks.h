@@ -6,12 +6,45 @@
 #include <set>
 #include <limits>
 #include <random>
+#include <iostream>
+#include "patternstore.h"
+#include "snapshot.h"
+#include "transcoder.h"
+#include "scoring.h"
+#include "frozenmodel.h"
+#include "staticmodel.h"
+#include "wordbook.h"
+#include "scaletuner.h"
+#include "stats.h"
+#include "random.h"
 
 using std::vector;
 using std::map;
 using std::string;
 using std::set;
 
+/// Result of classifying a single word
+struct Classification {
+    unsigned label {}; /// Index of the chosen language
+    vector<double> scores; /// Propability per language
+};
+
+/// Criteria of Brain::compact, patterns are dropped if any of them applies
+struct CompactOptions {
+    unsigned min_count {2}; /// Patterns seen less often are dropped
+    double max_entropy {1.0}; /// Patterns with a higher entropy (1 is uniform) are dropped
+    size_t top_k {0}; /// Patterns kept per position at most, 0 keeps all
+};
+
+/// Result of classifying a whole document
+struct DocumentClassification {
+    unsigned label {}; /// Index of the chosen language
+    double confidence {}; /// Mean rate of the chosen language minus the runner-up
+    unsigned tokens {}; /// Words the decision is based on
+    bool early {false}; /// True if the document wasn't read to its end
+    vector<double> scores; /// Mean rate per language
+};
+
 /**
  * @brief This class maintains language recognition data
  * During initialisation charsets and a conversion list are loaded from specified files.
@@ -24,7 +57,13 @@ using std::set;
 class Brain {
 public:
     /// Default constructor
-    Brain(const unsigned minl, const unsigned maxl, const vector<string> langli, const unsigned plen = 0);
+    Brain(const unsigned minl, const unsigned maxl, const vector<string> langli, const unsigned plen = 0,
+          const unsigned workers = 1, const uint64_t seed = RandomStreams::clock_seed());
+    /// Loads a model snapshot, Brain.mind or the compiled table is served from the mapped file
+    explicit Brain(const string model_file, const uint64_t seed = RandomStreams::clock_seed());
+
+    /// Saves a model snapshot, false if it can't be written
+    bool save_model(const string model_file) const;
 
     /// Initialization routines
     void init_charsets(const string csfile = "../util/charset.txt");
@@ -36,6 +75,10 @@ public:
     void train_random();
     void train_random(const unsigned lang_index);
     void train_random_bulk(const unsigned word_count);
+    /// Trains Brain.mind on given words in parallel, same result as training them in order
+    void train_batch(const vector<Brainword>& words, const vector<unsigned>& langs);
+    /// Prints training speed per amount of worker threads
+    void train_scaling(const unsigned word_count);
 
     /// Tests Brain.mind on random word specified in Brain.wb
     unsigned test_random();
@@ -43,6 +86,10 @@ public:
     void test_random_bulk(const unsigned word_count);
     double test_random_bulk_silent(const unsigned word_count);
 
+    /// Classifies words in parallel, Brain.mind is only read, words are cut to Brain.maxlength2
+    vector<Classification> classify_batch(const vector<Brainword>& words) const;
+    vector<Classification> classify_batch(const vector<vector<unsigned char>>& words) const;
+
     /// Inits small unchanged test pool of words
     void init_trial_wb(const unsigned word_count);
     /// Returns succes rates per language tested on full trial pool
@@ -56,50 +103,144 @@ public:
     /// Functions to set and evaluate optimal scale values
     void autoset_scale(unsigned word_count, unsigned pmin, unsigned pmax, double step);
     void test_scale(unsigned word_count, unsigned pmin, unsigned pmax, double step, double smin, double smax);
-    void set_scale(unsigned pmin, unsigned pmax);
+    void set_scale(unsigned plen, double value);
+
+    /// Multiplies all counts of Brain.mind by factor, see Brain.decay_every for scheduled decaying
+    void decay(const double factor);
+
+    /// Drops rare and uninformative patterns, reports memory and success on trial_wb
+    void compact(const CompactOptions& options, const unsigned word_count, const bool apply = true);
+
+    /// Prints the share of missing slices per pattern length on trial_wb
+    void report_lookups(const unsigned word_count);
+
+    /// Runtime statistics, pattern counts and memory as JSON
+    string stats_json() const;
+
+    /// Freezes Brain.mind into normalized weights used for testing, the count rows get dropped
+    void freeze(const FrozenModel::Precision precision = FrozenModel::FLOAT32);
+    /// Prints success rate and model memory of the counts and of each precision
+    void compare_precisions(const unsigned word_count);
+    /// Compiles Brain.mind into a static hash table used for testing and releases Brain.mind
+    void compile();
 
     void train_on_file(const string file, const unsigned lang_index);
     void test_on_file(const string file);
+    /// Classifies a document word by word until the leading language is confident enough
+    DocumentClassification classify_document(std::istream& in, const double confidence, const unsigned min_tokens = 20,
+                                             const unsigned max_tokens = 0);
+    void test_document(const string file, const double confidence);
+    /// Classifies every line of in, writes label and scores per line to out
+    void classify_stream(std::istream& in, std::ostream& out);
 
     const unsigned minlength; /// Minimum length of words
     const unsigned maxlength; /// Maximum length of words
-    unsigned maxlength2; /// Actual maximum length (+1 end sign)
+    unsigned maxlength2 {0}; /// Actual maximum length (+1 end sign)
     const vector<string> langlist; /// List of language names
     const unsigned nlang; /// Count of languages
-    vector<vector<vector<unsigned char>>> wb; /// Wordbook sorted by languages
-    vector<vector<vector<unsigned char>>> trial_wb; /// Small wordbook for testing
-    const vector<unsigned> init_rating; /// Default template for Brain.mind data
+    vector<Wordbook> wb; /// Wordbook sorted by languages, one arena per language
+    vector<vector<unsigned>> trial_wb; /// Indices into Brain.wb per language of a small pool for testing
+    static string wordbook_cache; /// Converted wordbooks reused by import_wordbooks, set before constructing, empty disables
     unsigned max_pattern_len; /// The maximum relevant pattern length used
     double def_rating = 1.0 / nlang; /// Default rating per language if no val given
-    vector<map<vector<unsigned char>, vector<unsigned>>> mind; /// All Ratings
+    vector<PatternStore> mind; /// All Ratings, one pattern store per position
     set<wchar_t> unidentified_chs {}; /// List of unidentified chars found by str_to_brwrd
     unsigned discard_count {0}; /// Count of discarded words by str_to_brwrd
-    std::minstd_rand r_generator;
+    RandomStreams random; /// Random streams of training, testing and the trial pool
 
     unsigned polling_rate {10'000}; /// Rate at which progress of train or test is printed
-    const unsigned MAX_VAL {std::numeric_limits<unsigned>::max()}; /// Maximum value of rate
+    unsigned threads {1}; /// Worker threads used for training and testing (0 means all cores)
+    unsigned batch_size {10'000}; /// Words trained or tested per parallel batch
+    unsigned decay_every {0}; /// Words trained between two decays of Brain.mind, 0 disables decaying
+    double decay_factor {0.5}; /// Factor applied to all counts by a scheduled decay
     const unsigned char KILL_CHAR {255}; /// Char which indicates failed conversion
-    vector<double> scale {}; /// Scale which amplifies ratings per pattern accordingly
+    vector<double> scale {}; /// Scale which amplifies ratings per pattern accordingly, change with set_scale
+    mutable Stats stats; /// Counters and latency histograms of training and testing
+    bool specialized {true}; /// Rates words with compile time specializations where available
 
 private:
-    /// Maps used by str_to_brwrd
-    map<char, unsigned char> charset1;
-    map<wchar_t, unsigned char> charset2;
-    map<wchar_t, string> conversion;
-    set<char> ignore1;
-    set<wchar_t> ignore2;
+    friend class BrainBench; /// Microbenchmarks of get-lang-bench time private steps
+    friend class OnlineModel; /// Trains and tests copies of Brain.mind
+    friend class Server; /// Converts and classifies requests
+
+    Brain(SnapshotReader&& reader, const uint64_t seed);
+    Brain(SnapshotReader& reader, const ModelHeader& header, const uint64_t seed);
+
+    /// Compiled charsets, ignore and conversion lists used by str_to_brwrd
+    Transcoder transcoder;
+    /// Fastest kernels adding up counts of pattern hits
+    const ScoreKernel score_kernel {select_score_kernel()};
+    const NarrowKernel narrow_kernel {select_narrow_kernel()};
+    /// Words trained since the last scheduled decay
+    size_t trained_since_decay {0};
+    /// Normalized weights used by test_single once frozen
+    FrozenModel frozen;
+    /// Static table of Brain.mind used by test_single once compiled
+    StaticModel compiled;
 
     /// Converts String to brainword
-    vector<unsigned char> str_to_brwrd(string word, bool check_len = true);
+    vector<unsigned char> str_to_brwrd(const string& word, bool check_len = true);
+    bool str_to_brwrd(const string& word, vector<unsigned char>& brwrd, bool check_len = true);
+    /// Converts text to brainword, unknown chars are collected in unknown
+    bool convert_word(const char* text, const size_t len, vector<unsigned char>& brwrd, bool check_len,
+                      set<wchar_t>& unknown) const;
     /// Converts brainword to String
     string brwrd_to_str(vector<unsigned char> brwd) const;
-    /// Halves rates (usually when MAX_VAL is reached)
-    void shrink(unsigned pos, vector<unsigned char> slice);
-
-    /// Trains Brain.mind on given word
-    void train_single(vector<unsigned char> word, unsigned lang_index);
+    /// Multiplies all counts of given pattern stores by factor
+    void decay_stores(vector<PatternStore>& stores, const double factor) const;
+    /// Decays Brain.mind if Brain.decay_every words were trained since the last decay
+    void schedule_decay(const size_t words);
+
+    /// Trains Brain.mind on given word as if it was seen weight times
+    void train_single(const Brainword& word, unsigned lang_index, const unsigned weight = 1);
+    /// Trains all slices of a word starting at given position
+    void train_position(PatternStore& store, const Brainword& word, unsigned lang_index, unsigned pos,
+                        const unsigned weight = 1) const;
+    /// Trains pattern stores on words, equal words are merged and positions are split among workers
+    void train_sharded(vector<PatternStore>& target, const vector<Brainword>& words,
+                       const vector<unsigned>& langs, const unsigned workers) const;
+    /// Merges equal words of the same language into one word with the amount of them as weight
+    static void merge_words(const vector<Brainword>& words, const vector<unsigned>& langs, vector<Brainword>& merged,
+                            vector<unsigned>& merged_langs, vector<unsigned>& weights);
+    /// Trains on collected words of a file and clears them
+    void train_file_batch(vector<vector<unsigned char>>& batch, const unsigned lang_index);
     /// Returns propability of languages on given word
-    vector<double> test_single(vector<unsigned char> word) const;
+    vector<double> test_single(const Brainword& word) const;
+    void test_single(const Brainword& word, vector<double>& scratch, double* ratings) const;
+    /// Tests a single word on given pattern stores, the frozen model is ignored
+    void test_stores(const vector<PatternStore>& stores, const Brainword& word, vector<double>& scratch,
+                     double* ratings) const;
+    /// Turns ratings per pattern length into propabilities per language
+    void scale_patterns(const Brainword& word, const unsigned plen, const vector<double>& rating_per_pattern,
+                        double* ratings) const;
+    /// Sums up ratings of a word per pattern length, returns the amount of lengths
+    unsigned rate_patterns(const vector<PatternStore>& stores, const Brainword& word,
+                           vector<double>& rating_per_pattern) const;
+    /// Caches pattern ratings of all words in Brain.trial_wb
+    ScaleTuner trial_tuner() const;
+    /// Draws random words of Brain.wb from the stream of a phase
+    bool draw_random(const unsigned word_count, vector<Brainword>& words, vector<unsigned>& langs,
+                     const RandomStreams::Phase phase);
+    /// Converts one wordbook source without changing Brain
+    void import_wordbook(const string& file, Wordbook& words, unsigned& discards, set<wchar_t>& unknown) const;
+    /// Serves Brain.wb from the wordbook cache if it matches the settings and sources
+    bool map_wordbook_cache();
+    /// Writes Brain.wb to the wordbook cache
+    void save_wordbook_cache() const;
+    /// Size and modification time of every wordbook source
+    vector<int64_t> wordbook_stamps() const;
+    /// Checks if words of all languages are available
+    bool has_wordbooks() const;
+    /// Checks if Brain.mind still holds counts after Brain::compile and Brain::freeze
+    bool has_counts(const char* action) const;
+    /// Tests random words in parallel batches and counts hits per language
+    void test_random_batches(const unsigned word_count, vector<unsigned>& amounts, vector<unsigned>& hits, bool verbose);
+    /// Converts the words of a line of text and appends them to batch
+    void convert_line(string line, vector<vector<unsigned char>>& batch, set<wchar_t>& unknown) const;
+    /// Appends label and rates of every line of classified words to results
+    void format_lines(const vector<Classification>& classes, const vector<size_t>& line_ends, string& results) const;
+    /// Classifies collected words of a file, adds up their rates and clears them
+    void test_file_batch(vector<vector<unsigned char>>& batch, vector<double>& ratings) const;
 
     static string base_path;
 };